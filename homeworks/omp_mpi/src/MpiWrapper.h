@@ -13,10 +13,18 @@ typedef struct {
 
 int mpi_init(Mpi* mpi, int* argc, char*** argv) {
     int hostname_len;
-    if (MPI_Init(argc, &argv) != MPI_SUCCESS) {
+    // the master thread of an OpenMP team makes MPI calls while the other
+    // threads of the team compute
+    int provided = MPI_THREAD_SINGLE;
+    if (MPI_Init_thread(argc, argv, MPI_THREAD_FUNNELED, &provided)
+        != MPI_SUCCESS) {
         fprintf(stderr, "Error: could not init mpi\n");
         return -1;
     }
+    if (provided < MPI_THREAD_FUNNELED) {
+        fprintf(stderr, "Error: mpi does not support MPI_THREAD_FUNNELED\n");
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
     if (MPI_Comm_rank(MPI_COMM_WORLD, &mpi->rank) != MPI_SUCCESS) {
         fprintf(stderr, "Error: could not get MPI rank\n");
         return -1;
@@ -0,0 +1,280 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#include "codec.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "plate.h"
+#include "solution.h"
+
+/// Bytes of a double, every one goes to its own plane
+#define PLANE_COUNT 8
+#define SYMBOL_COUNT 256
+#define DECODE_TABLE_SIZE (1 << CODEC_MAX_CODE_LENGTH)
+/// Mode byte, 4 bits per code length, 8 bytes of bitstream size
+#define HUFFMAN_HEADER_SIZE (1 + SYMBOL_COUNT / 2 + sizeof(uint64_t))
+
+/**
+ * @brief How a byte plane is stored.
+ */
+typedef enum {
+  PLANE_CONSTANT,  /// < the byte every value has
+  PLANE_RAW,  /// < the bytes as they are
+  PLANE_HUFFMAN  /// < code lengths, bitstream size and bitstream
+} PlaneMode;
+
+/**
+ * @brief First bytes of a compressed plate file. The compressed size of
+ * every block follows, then the blocks.
+ */
+typedef struct {
+    uint64_t magic;  /// < PLATE_CODEC_MAGIC
+    uint64_t rows;  /// < rows of the plate
+    uint64_t cols;  /// < columns of the plate
+    uint64_t blockRows;  /// < rows of every block, the last may have less
+} CodecHeader;
+
+/**
+ * @brief Reads codes from a buffer, most significant bit first.
+ */
+typedef struct {
+    const unsigned char* bytes;  /// < the input
+    size_t size;  /// < bytes of the input
+    size_t position;  /// < next byte to load, may pass the end
+    uint64_t buffer;  /// < loaded bits, in the low bits
+    int count;  /// < number of loaded bits
+} BitReader;
+
+static inline unsigned peekBits(BitReader* reader) {
+  // past the end the stream reads as zeros, the caller checks the size
+  while (reader->count <= 56) {
+    reader->buffer = reader->buffer << 8 | (reader->position < reader->size
+      ? reader->bytes[reader->position] : 0);
+    ++reader->position;
+    reader->count += 8;
+  }
+  return (unsigned) (reader->buffer >> (reader->count
+    - CODEC_MAX_CODE_LENGTH)) & (DECODE_TABLE_SIZE - 1);
+}
+
+// Canonical codes: shorter codes first, then by symbol
+static void assignCodes(const unsigned char* lengths, uint32_t* codes) {
+  size_t lengthCounts[CODEC_MAX_CODE_LENGTH + 1] = {0};
+  for (size_t symbol = 0; symbol < SYMBOL_COUNT; ++symbol) {
+    ++lengthCounts[lengths[symbol]];
+  }
+  lengthCounts[0] = 0;
+  uint32_t nextCodes[CODEC_MAX_CODE_LENGTH + 1];
+  uint32_t code = 0;
+  for (int length = 1; length <= CODEC_MAX_CODE_LENGTH; ++length) {
+    code = (code + lengthCounts[length - 1]) << 1;
+    nextCodes[length] = code;
+  }
+  for (size_t symbol = 0; symbol < SYMBOL_COUNT; ++symbol) {
+    if (lengths[symbol] > 0) {
+      codes[symbol] = nextCodes[lengths[symbol]]++;
+    }
+  }
+}
+
+// Returns the bytes of the plane in the input, 0 if it is corrupt
+static size_t decodePlane(const unsigned char* input, size_t available,
+  size_t count, unsigned char* bytes) {
+  if (available < 2) {
+    return 0;
+  }
+  if (input[0] == PLANE_CONSTANT) {
+    memset(bytes, input[1], count);
+    return 2;
+  }
+  if (input[0] == PLANE_RAW) {
+    if (available - 1 < count) {
+      return 0;
+    }
+    memcpy(bytes, input + 1, count);
+    return 1 + count;
+  }
+  if (input[0] != PLANE_HUFFMAN || available < HUFFMAN_HEADER_SIZE) {
+    return 0;
+  }
+
+  unsigned char lengths[SYMBOL_COUNT];
+  size_t kraftSum = 0;
+  for (size_t symbol = 0; symbol < SYMBOL_COUNT; ++symbol) {
+    lengths[symbol] = input[1 + symbol / 2] >> (symbol % 2 * 4) & 0xF;
+    if (lengths[symbol] > CODEC_MAX_CODE_LENGTH) {
+      return 0;
+    }
+    if (lengths[symbol] > 0) {
+      kraftSum += (size_t) 1 << (CODEC_MAX_CODE_LENGTH - lengths[symbol]);
+    }
+  }
+  uint64_t streamSize = 0;
+  memcpy(&streamSize, input + 1 + SYMBOL_COUNT / 2, sizeof(streamSize));
+  // a code that overflows the table is not a prefix code
+  if (kraftSum > DECODE_TABLE_SIZE
+    || streamSize > available - HUFFMAN_HEADER_SIZE) {
+    return 0;
+  }
+
+  // every entry holds the symbol and the length of the code it starts with
+  uint32_t codes[SYMBOL_COUNT];
+  assignCodes(lengths, codes);
+  uint16_t* table = calloc(DECODE_TABLE_SIZE, sizeof(uint16_t));
+  assert(table != NULL);
+  for (size_t symbol = 0; symbol < SYMBOL_COUNT; ++symbol) {
+    if (lengths[symbol] > 0) {
+      const int shift = CODEC_MAX_CODE_LENGTH - lengths[symbol];
+      for (uint32_t entry = codes[symbol] << shift;
+        entry < (codes[symbol] + 1) << shift; ++entry) {
+        table[entry] = symbol | lengths[symbol] << 8;
+      }
+    }
+  }
+
+  BitReader reader = {input + HUFFMAN_HEADER_SIZE, streamSize, 0, 0, 0};
+  int isValid = 1;
+  for (size_t index = 0; index < count && isValid; ++index) {
+    const uint16_t entry = table[peekBits(&reader)];
+    isValid = entry >> 8 != 0;
+    bytes[index] = entry & 0xFF;
+    reader.count -= entry >> 8;
+  }
+  free(table);
+  // the codes must end within the stream
+  if (!isValid || reader.position * 8 - reader.count > streamSize * 8) {
+    return 0;
+  }
+  return HUFFMAN_HEADER_SIZE + streamSize;
+}
+
+// Predicts a cell from the ones above and on its left (Lorenzo predictor),
+// only with cells of the same block, so blocks are coded independently
+static inline double predictCell(const Plate* plate, size_t startRow,
+  size_t row, size_t col) {
+  if (row > startRow && col > 0) {
+    return PLATE_ROW(plate, row - 1)[col] + PLATE_ROW(plate, row)[col - 1]
+      - PLATE_ROW(plate, row - 1)[col - 1];
+  }
+  if (row > startRow) {
+    return PLATE_ROW(plate, row - 1)[col];
+  }
+  return col > 0 ? PLATE_ROW(plate, row)[col - 1] : 0.0;
+}
+
+static inline double decodeResidual(uint64_t residual, double prediction) {
+  uint64_t predictionBits;
+  memcpy(&predictionBits, &prediction, sizeof(predictionBits));
+  const uint64_t difference = residual & 1 ? ~(residual >> 1)
+    : residual >> 1;
+  const uint64_t bits = predictionBits + difference;
+  double cell;
+  memcpy(&cell, &bits, sizeof(cell));
+  return cell;
+}
+
+static int decompressBlock(Plate* plate, size_t startRow, size_t endRow,
+  const unsigned char* input, size_t size) {
+  const size_t count = (endRow - startRow) * plate->cols;
+  unsigned char* planes = malloc(PLANE_COUNT * count + 1);
+  assert(planes != NULL);
+  size_t used = 0;
+  for (size_t plane = 0; plane < PLANE_COUNT; ++plane) {
+    const size_t planeSize = decodePlane(input + used, size - used, count,
+      planes + plane * count);
+    if (planeSize == 0) {
+      free(planes);
+      return 0;
+    }
+    used += planeSize;
+  }
+
+  size_t index = 0;
+  for (size_t row = startRow; row < endRow; ++row) {
+    for (size_t col = 0; col < plate->cols; ++col, ++index) {
+      uint64_t residual = 0;
+      for (size_t plane = 0; plane < PLANE_COUNT; ++plane) {
+        residual |= (uint64_t) planes[plane * count + index] << (8 * plane);
+      }
+      PLATE_ROW(plate, row)[col] = decodeResidual(residual,
+        predictCell(plate, startRow, row, col));
+    }
+  }
+  free(planes);
+  return used == size;
+}
+
+int isCompressedPlate(const void* file, size_t fileSize) {
+  uint64_t magic = 0;
+  if (fileSize < sizeof(magic)) {
+    return 0;
+  }
+  memcpy(&magic, file, sizeof(magic));
+  return magic == PLATE_CODEC_MAGIC;
+}
+
+int readCompressedPlateSize(const void* file, size_t fileSize, size_t* rows,
+  size_t* cols) {
+  uint64_t header[3];
+  if (!isCompressedPlate(file, fileSize) || fileSize < sizeof(header)) {
+    return 0;
+  }
+  memcpy(header, file, sizeof(header));
+  *rows = header[1];
+  *cols = header[2];
+  return 1;
+}
+
+Plate* readCompressedPlate(const void* file, size_t fileSize) {
+  CodecHeader header;
+  if (!isCompressedPlate(file, fileSize) || fileSize < sizeof(header)) {
+    return NULL;
+  }
+  memcpy(&header, file, sizeof(header));
+  if (header.blockRows == 0 || (header.rows > 0
+    && header.cols > SIZE_MAX / sizeof(double) / header.rows)) {
+    return NULL;
+  }
+
+  const unsigned char* input = (const unsigned char*) file;
+  const size_t blocksCount = header.rows / header.blockRows
+    + (header.rows % header.blockRows != 0);
+  if (blocksCount > (fileSize - sizeof(header)) / sizeof(uint64_t)) {
+    return NULL;
+  }
+  size_t* blockOffsets = malloc((blocksCount + 1) * sizeof(size_t));
+  size_t* blockSizes = malloc((blocksCount + 1) * sizeof(size_t));
+  assert(blockOffsets != NULL && blockSizes != NULL);
+  size_t offset = sizeof(header) + blocksCount * sizeof(uint64_t);
+  int isValid = 1;
+  for (size_t block = 0; block < blocksCount && isValid; ++block) {
+    uint64_t size;
+    memcpy(&size, input + sizeof(header) + block * sizeof(uint64_t),
+      sizeof(size));
+    isValid = size <= fileSize - offset;
+    blockOffsets[block] = offset;
+    blockSizes[block] = size;
+    offset += isValid ? size : 0;
+  }
+
+  Plate* plate = NULL;
+  if (isValid) {
+    plate = createPlate(header.rows, header.cols);
+    const size_t blockRows = header.blockRows;
+    int isCorrupt = 0;
+    #pragma omp parallel for schedule(dynamic) reduction(||:isCorrupt)
+    for (size_t block = 0; block < blocksCount; ++block) {
+      const size_t startRow = block * blockRows;
+      const size_t endRow = startRow + blockRows < plate->rows
+        ? startRow + blockRows : plate->rows;
+      isCorrupt = !decompressBlock(plate, startRow, endRow,
+        input + blockOffsets[block], blockSizes[block]) || isCorrupt;
+    }
+    if (isCorrupt) {
+      destroyPlate(plate);
+      plate = NULL;
+    }
+  }
+  free(blockOffsets);
+  free(blockSizes);
+  return plate;
+}
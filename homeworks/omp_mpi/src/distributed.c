@@ -0,0 +1,308 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#include "distributed.h"
+#include <assert.h>
+#include <mpi.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "codec.h"
+#include "input.h"
+#include "output.h"
+#include "plate.h"
+#include "solution.h"
+
+/// Rank that writes the TSV file and the header of the plates
+#define DISTRIBUTED_MAIN_PROCESS 0
+
+/**
+ * @brief The rows of a plate a process updates, and the ones it keeps.
+ *
+ * A process owns the global rows [firstRow, endRow) and keeps a copy of the
+ * row before and the row after them, when the plate has them, so its local
+ * plate holds the global rows [firstLocalRow, endLocalRow).
+ */
+typedef struct {
+    size_t rows;  /// < rows of the whole plate
+    size_t cols;  /// < columns of the whole plate
+    size_t firstRow;  /// < first global row owned by the process
+    size_t endRow;  /// < global row after the last owned one
+    size_t firstLocalRow;  /// < global row of the first local row
+    size_t endLocalRow;  /// < global row after the last local row
+    int up;  /// < rank that owns the rows above, or MPI_PROC_NULL
+    int down;  /// < rank that owns the rows below, or MPI_PROC_NULL
+} RowBlock;
+
+// Splits the rows evenly among the first activeCount ranks
+static RowBlock planRowBlock(size_t rows, size_t cols, int rank,
+  int activeCount) {
+  RowBlock block = {rows, cols, 0, 0, 0, 0, MPI_PROC_NULL, MPI_PROC_NULL};
+  if (rank >= activeCount) {
+    return block;
+  }
+  block.firstRow = rows * rank / activeCount;
+  block.endRow = rows * (rank + 1) / activeCount;
+  block.firstLocalRow = block.firstRow > 0 ? block.firstRow - 1 : 0;
+  block.endLocalRow = block.endRow < rows ? block.endRow + 1 : rows;
+  block.up = rank > 0 ? rank - 1 : MPI_PROC_NULL;
+  block.down = rank + 1 < activeCount ? rank + 1 : MPI_PROC_NULL;
+  return block;
+}
+
+static void failDistributed(const char* message, const char* path) {
+  fprintf(stderr, "Error: %s %s\n", message, path);
+  MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+}
+
+// Datatype of count rows of a local plate, the padding is skipped
+static MPI_Datatype createRowsType(const Plate* plate, size_t count) {
+  MPI_Datatype rowsType;
+  MPI_Type_vector((int) count, (int) plate->cols, (int) plate->stride,
+    MPI_DOUBLE, &rowsType);
+  MPI_Type_commit(&rowsType);
+  return rowsType;
+}
+
+// Every process decodes a compressed plate whole and keeps its local rows,
+// the blocks of the file are not aligned to the rows of the processes
+static Plate* readCompressedPlateBlock(const JobData* jobData,
+  const char* path, RowBlock* block, int rank, int processCount) {
+  Plate* plate = readPlate(jobData->plateFile, jobData->directory);
+  if (plate->rows < 1 || plate->cols < 1) {
+    failDistributed("invalid plate", path);
+  }
+  const int activeCount = plate->rows < (size_t) processCount
+    ? (int) plate->rows : processCount;
+  *block = planRowBlock(plate->rows, plate->cols, rank, activeCount);
+  const size_t localRows = block->endLocalRow - block->firstLocalRow;
+  Plate* localPlate = createPlate(localRows > 0 ? localRows : 1, plate->cols);
+  for (size_t row = 0; row < localRows; ++row) {
+    memcpy(PLATE_ROW(localPlate, row), PLATE_ROW(plate, block->firstLocalRow
+      + row), plate->cols * sizeof(double));
+  }
+  destroyPlate(plate);
+  return localPlate;
+}
+
+// Reads the header of the plate and the local rows of every process
+static Plate* readPlateBlock(const JobData* jobData, const char* path,
+  RowBlock* block, int rank, int processCount) {
+  MPI_File file;
+  if (MPI_File_open(MPI_COMM_WORLD, path, MPI_MODE_RDONLY, MPI_INFO_NULL,
+    &file) != MPI_SUCCESS) {
+    failDistributed("could not open plate", path);
+  }
+  // the third number is only read to find the magic of a compressed plate
+  uint64_t size[3] = {0, 0, 0};
+  MPI_Offset fileSize = 0;
+  MPI_File_read_at_all(file, 0, size, 3, MPI_UINT64_T, MPI_STATUS_IGNORE);
+  MPI_File_get_size(file, &fileSize);
+  if (isCompressedPlate(size, sizeof(size))) {
+    MPI_File_close(&file);
+    return readCompressedPlateBlock(jobData, path, block, rank,
+      processCount);
+  }
+  if (size[0] < 1 || size[1] < 1 || (uint64_t) (fileSize
+    - PLATE_HEADER_SIZE) / sizeof(double) < size[0] * size[1]) {
+    failDistributed("invalid plate", path);
+  }
+
+  // a process without rows takes part in the collective calls only
+  const int activeCount = size[0] < (uint64_t) processCount
+    ? (int) size[0] : processCount;
+  *block = planRowBlock(size[0], size[1], rank, activeCount);
+  const size_t localRows = block->endLocalRow - block->firstLocalRow;
+  Plate* plate = createPlate(localRows > 0 ? localRows : 1, size[1]);
+  MPI_Datatype rowsType = createRowsType(plate, localRows);
+  MPI_File_read_at_all(file, PLATE_HEADER_SIZE + block->firstLocalRow
+    * block->cols * sizeof(double), plate->data, localRows > 0, rowsType,
+    MPI_STATUS_IGNORE);
+  MPI_Type_free(&rowsType);
+  MPI_File_close(&file);
+  return plate;
+}
+
+// Writes the owned rows of every process, the main process adds the header
+static void writePlateBlock(const char* path, const Plate* plate,
+  const RowBlock* block, int rank) {
+  MPI_File file;
+  if (MPI_File_open(MPI_COMM_WORLD, path, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+    MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+    failDistributed("could not create plate", path);
+  }
+  MPI_File_set_size(file, PLATE_HEADER_SIZE + block->rows * block->cols
+    * sizeof(double));
+  const uint64_t size[2] = {block->rows, block->cols};
+  MPI_File_write_at_all(file, 0, size, rank == DISTRIBUTED_MAIN_PROCESS ? 2
+    : 0, MPI_UINT64_T, MPI_STATUS_IGNORE);
+
+  const size_t ownedRows = block->endRow - block->firstRow;
+  MPI_Datatype rowsType = createRowsType(plate, ownedRows);
+  MPI_File_write_at_all(file, PLATE_HEADER_SIZE + block->firstRow
+    * block->cols * sizeof(double), PLATE_ROW(plate, block->firstRow
+    - block->firstLocalRow), ownedRows > 0, rowsType, MPI_STATUS_IGNORE);
+  MPI_Type_free(&rowsType);
+  MPI_File_close(&file);
+}
+
+// Starts sending the first and last owned rows to the neighbours, and
+// receiving their rows into the copies around the block. The owned rows
+// must not change, nor the copies be read, until the requests complete
+static int startHaloExchange(Plate* plate, const RowBlock* block,
+  MPI_Request* requests) {
+  const int cols = (int) block->cols;
+  const size_t firstOwned = block->firstRow - block->firstLocalRow;
+  const size_t lastOwned = block->endRow - 1 - block->firstLocalRow;
+  const size_t lastLocal = block->endLocalRow - 1 - block->firstLocalRow;
+  int requestCount = 0;
+  if (block->up != MPI_PROC_NULL) {
+    MPI_Irecv(PLATE_ROW(plate, 0), cols, MPI_DOUBLE, block->up, 1,
+      MPI_COMM_WORLD, &requests[requestCount++]);
+    MPI_Isend(PLATE_ROW(plate, firstOwned), cols, MPI_DOUBLE, block->up, 0,
+      MPI_COMM_WORLD, &requests[requestCount++]);
+  }
+  if (block->down != MPI_PROC_NULL) {
+    MPI_Irecv(PLATE_ROW(plate, lastLocal), cols, MPI_DOUBLE, block->down, 0,
+      MPI_COMM_WORLD, &requests[requestCount++]);
+    MPI_Isend(PLATE_ROW(plate, lastOwned), cols, MPI_DOUBLE, block->down, 1,
+      MPI_COMM_WORLD, &requests[requestCount++]);
+  }
+  return requestCount;
+}
+
+// Simulates a job on every process, returns the iterations of the result
+static size_t simulateDistributed(const JobData* jobData, Arguments args,
+  int rank, int processCount) {
+  char* path = malloc(strlen(jobData->directory)
+    + strlen(jobData->plateFile) + 2);
+  assert(path != NULL);
+  sprintf(path, "%s/%s", jobData->directory, jobData->plateFile);
+  RowBlock block;
+  Plate* readPlate = readPlateBlock(jobData, path, &block, rank,
+    processCount);
+  free(path);
+  // the borders of the plate and the copies of the neighbour rows are kept
+  Plate* writePlate = copyPlate(readPlate);
+
+  const double factor = (jobData->duration * jobData->thermalDiffusivity) /
+    (jobData->plateCellDimmensions * jobData->plateCellDimmensions);
+  const StencilRowFunction updateRow = args.stencilKernel.updateRow;
+  // the owned rows that are not a border of the plate
+  const size_t firstRow = (block.firstRow > 0 ? block.firstRow : 1)
+    - block.firstLocalRow;
+  const size_t endRow = block.endRow < block.rows ? block.endRow
+    - block.firstLocalRow : block.rows - 1 - block.firstLocalRow;
+  const size_t cols = block.cols;
+  const int isActive = block.endRow > block.firstRow && cols > 2;
+  // the rows next to a neighbour's copy wait for the halos, the interior
+  // ones are updated while the halos travel
+  size_t boundaryRows[2];
+  size_t boundaryCount = 0;
+  size_t interiorFirst = firstRow;
+  size_t interiorEnd = isActive ? endRow : firstRow;
+  if (isActive && block.up != MPI_PROC_NULL && interiorFirst < interiorEnd) {
+    boundaryRows[boundaryCount++] = interiorFirst++;
+  }
+  if (isActive && block.down != MPI_PROC_NULL
+    && interiorFirst < interiorEnd) {
+    boundaryRows[boundaryCount++] = --interiorEnd;
+  }
+  // the boundary rows are split in column segments among the threads
+  const size_t segments = jobData->threadCount;
+  size_t iterations = 0;
+
+  while (1) {
+    const double* current = readPlate->data;
+    double* next = writePlate->data;
+    const size_t stride = readPlate->stride;
+    double maxDelta = 0.0;
+    // the copies read from the file are current on the first iteration
+    MPI_Request requests[4];
+    const int requestCount = isActive && iterations > 0
+      ? startHaloExchange(readPlate, &block, requests) : 0;
+    // one team per iteration: the main thread waits for the halos once its
+    // interior rows are done, then the boundary rows are shared
+    #pragma omp parallel num_threads(jobData->threadCount) \
+        reduction(max:maxDelta)
+    {
+      #pragma omp for schedule(static) nowait
+      for (size_t row = interiorFirst; row < interiorEnd; ++row) {
+        double rowDelta = updateRow(current + row * stride,
+          next + row * stride, stride, 1, cols - 1, factor);
+        maxDelta = rowDelta > maxDelta ? rowDelta : maxDelta;
+      }
+      #pragma omp master
+      MPI_Waitall(requestCount, requests, MPI_STATUSES_IGNORE);
+      #pragma omp barrier
+      #pragma omp for schedule(static)
+      for (size_t segment = 0; segment < boundaryCount * segments;
+        ++segment) {
+        const size_t row = boundaryRows[segment / segments];
+        const size_t part = segment % segments;
+        const size_t startCol = 1 + (cols - 2) * part / segments;
+        const size_t endCol = 1 + (cols - 2) * (part + 1) / segments;
+        double segmentDelta = updateRow(current + row * stride,
+          next + row * stride, stride, startCol, endCol, factor);
+        maxDelta = segmentDelta > maxDelta ? segmentDelta : maxDelta;
+      }
+    }
+    // every process, with rows or not, agrees on the balance
+    double globalDelta = 0.0;
+    MPI_Allreduce(&maxDelta, &globalDelta, 1, MPI_DOUBLE, MPI_MAX,
+      MPI_COMM_WORLD);
+    if (globalDelta <= jobData->balancePoint) {
+      break;
+    }
+    Plate* temp = readPlate;
+    readPlate = writePlate;
+    writePlate = temp;
+    ++iterations;
+  }
+
+  // the last state is in the write plate, as in simulate
+  char* resultPath = getResultPlatePath(jobData, iterations + 1);
+  if (rank == DISTRIBUTED_MAIN_PROCESS) {
+    printf("Writing plate to %s\n", resultPath);
+  }
+  writePlateBlock(resultPath, writePlate, &block, rank);
+  free(resultPath);
+  destroyPlate(readPlate);
+  destroyPlate(writePlate);
+  return iterations + 1;
+}
+
+void runDistributedJobs(Arguments args, int rank) {
+  int processCount = 1;
+  MPI_Comm_size(MPI_COMM_WORLD, &processCount);
+  // every process reads the job file, the plates are on a shared disk
+  size_t jobsCount = 0;
+  JobData* jobsData = readJobData(args.jobFile, &jobsCount);
+  SimulationResult* results = NULL;
+  ResultStream stream;
+  if (rank == DISTRIBUTED_MAIN_PROCESS) {
+    results = malloc(jobsCount * sizeof(SimulationResult));
+    assert(results != NULL);
+    openResultStream(&stream, jobsData, results, jobsCount);
+  }
+
+  for (size_t i = 0; i < jobsCount; i++) {
+    jobsData[i].threadCount = args.threadsCount;
+    const size_t iterations = simulateDistributed(&jobsData[i], args, rank,
+      processCount);
+    if (rank == DISTRIBUTED_MAIN_PROCESS) {
+      // the plate is already written, only the line is missing
+      results[i].plate = NULL;
+      results[i].iterations = iterations;
+      results[i].jobIndex = (int) i;
+      results[i].isSteady = 0;
+      results[i].residual = 0.0;
+      commitJobResult(&stream, i);
+    }
+  }
+
+  if (rank == DISTRIBUTED_MAIN_PROCESS) {
+    closeResultStream(&stream);
+    free(results);
+  }
+  destroyJobsData(jobsData);
+}
@@ -0,0 +1,23 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#pragma once
+#include <stddef.h>
+#include "types.h"
+
+/**
+ * @brief Runs every job on all the processes together.
+ *
+ * Instead of a job per worker, the plate of each job is split in blocks of
+ * rows, one per process, so a plate bigger than the memory of a node can be
+ * simulated. Every process reads its block and the rows around it straight
+ * from the plate file, updates its rows with the OpenMP kernel, and swaps
+ * its first and last rows with its neighbours after every iteration. The
+ * biggest change is combined with an MPI_Allreduce. The final plate is
+ * written by all the processes at once with MPI-IO, and the main process
+ * writes the TSV file.
+ *
+ * Must be called by every process, after MPI is initialized.
+ *
+ * @param args The arguments, the same on every process.
+ * @param rank The rank of this process.
+ */
+void runDistributedJobs(Arguments args, int rank);
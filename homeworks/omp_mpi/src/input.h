@@ -18,17 +18,16 @@ Arguments processArguments(int argc, char** argv);
 /**
  * Reads job data from a specified job file.
  *
- * @param jobFile The path to the job file.
- * @return A pointer to the JobData structure containing the read job data.
- */
-JobData* readJobData(const char* jobFile);
-/**
- * Calculates the number of lines in a file.
+ * The file is parsed in one pass, a job per line: the plate file, the
+ * duration, the thermal diffusivity, the cell dimensions and the balance
+ * point. Blank lines are skipped. A malformed line ends the program with
+ * its line number.
  *
- * @param filePath The path to the file.
- * @return The number of lines in the file.
+ * @param jobFile The path to the job file.
+ * @param jobsCount Receives the number of jobs read.
+ * @return The jobs, freed with destroyJobsData.
  */
-size_t calcFileLinesCount(const char* filePath);
+JobData* readJobData(const char* jobFile, size_t* jobsCount);
 
 /**
  * Reads a matrix from a binary file that represents a plate.
@@ -40,6 +39,20 @@ size_t calcFileLinesCount(const char* filePath);
 Plate* readPlate(const char* binaryFilpath, char* directory);
 
 
+/**
+ * @brief Reads the size of a plate from the header of its file.
+ *
+ * Only the header is read, the cells are not. The plate may be compressed.
+ *
+ * @param binaryFilepath The filepath of the binary file.
+ * @param directory The directory where the binary file is located.
+ * @param rows Receives the rows of the plate.
+ * @param cols Receives the columns of the plate.
+ * @return 1 on success, 0 if the header could not be read.
+ */
+int readPlateSize(const char* binaryFilepath, const char* directory,
+  size_t* rows, size_t* cols);
+
 /**
  * Retrieves the directory from a given file path.
  *
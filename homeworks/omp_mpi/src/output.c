@@ -1,14 +1,16 @@
 // Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include "types.h"
 #include "output.h"
-#define MAX_PATH_SIZE 100
+#include "plate.h"
 
 void printPlate(Plate* plate) {
   for (size_t i = 0; i < plate->rows; i++) {
     for (size_t j = 0; j < plate->cols; j++) {
-      printf("%.1lf ", plate->data[i][j]);
+      printf("%.1lf ", PLATE_ROW(plate, i)[j]);
     }
     printf("\n");
   }
@@ -32,48 +34,95 @@ void writePlate(Plate* plate, const char* binaryFilepath) {
   fwrite(&plate->rows, sizeof(size_t), 1, binaryFile);
   fwrite(&plate->cols, sizeof(size_t), 1, binaryFile);
 
-  for (size_t i=0; i< plate->rows; i++) {
-      fwrite(plate->data[i], sizeof(double), plate->cols, binaryFile);
+  if (plate->stride == plate->cols) {
+    fwrite(plate->data, sizeof(double), plate->rows * plate->cols, binaryFile);
+  } else {
+    // padded rows are written one by one, stdio merges them in its buffer
+    for (size_t i = 0; i < plate->rows; i++) {
+      fwrite(PLATE_ROW(plate, i), sizeof(double), plate->cols, binaryFile);
+    }
   }
 
   fclose(binaryFile);
 }
 
 
-void writeJobsResult(JobData* jobsData, SimulationResult* results,
-  size_t jobsCount, char* filepath) {
-  FILE *file;
-  char* jobNumbers = malloc(100 * sizeof(char));
-  char* path = malloc(100 * sizeof(char));
+FILE* openJobsResult(const JobData* jobsData) {
+  // the numbers are at most the plate name
+  char* jobNumbers = malloc(strlen(jobsData[0].plateFile) + 1);
+  const size_t pathSize = strlen(jobsData[0].directory)
+    + strlen(jobsData[0].plateFile) + sizeof("/job.tsv");
+  char* path = malloc(pathSize);
+  assert(jobNumbers != NULL && path != NULL);
   extractNumbers(jobsData[0].plateFile, jobNumbers);
-  snprintf(path, MAX_PATH_SIZE, "%s/job%s.tsv", jobsData[0].directory,
+  snprintf(path, pathSize, "%s/job%s.tsv", jobsData[0].directory,
     jobNumbers);
   printf("Writing results to %s\n", path);
-  file = fopen(path, "w");
+  FILE* file = fopen(path, "w");
 
   if (!file) {
-      printf("Error opening file %s\n", filepath);
+      printf("Error opening file %s\n", path);
       exit(EXIT_FAILURE);
   }
+  free(path);
+  free(jobNumbers);
+  return file;
+}
 
-  for (size_t i = 0; i < jobsCount; i++) {
-    writeJobResult(jobsData[i], results[i], file);
-    // TO-DO print plate in binary file
-    char* binaryFilepath = malloc(100 * sizeof(char));
-    removeExtension(jobsData[i].plateFile);
-    snprintf(binaryFilepath, MAX_PATH_SIZE, "%s/%s-%zu.bin",
-    jobsData[i].directory, jobsData[i].plateFile, results[i].iterations);
+char* getResultPlatePath(const JobData* jobData, size_t iterations) {
+  // the job keeps its file name, the extension is removed on a copy
+  const size_t plateNameSize = strlen(jobData->plateFile) + 1;
+  char* plateName = malloc(plateNameSize);
+  // room for the directory, the name and up to 20 digits of iterations
+  const size_t pathSize = strlen(jobData->directory) + plateNameSize
+    + sizeof("/-.bin") + 20;
+  char* binaryFilepath = malloc(pathSize);
+  assert(plateName != NULL && binaryFilepath != NULL);
+  memcpy(plateName, jobData->plateFile, plateNameSize);
+  removeExtension(plateName);
+  snprintf(binaryFilepath, pathSize, "%s/%s-%zu.bin", jobData->directory,
+    plateName, iterations);
+  free(plateName);
+  return binaryFilepath;
+}
 
+void writeResultPlate(JobData jobData, SimulationResult result) {
+  char* binaryFilepath = getResultPlatePath(&jobData, result.iterations);
+  printf("Writing plate to %s\n", binaryFilepath);
+  writePlate(result.plate, binaryFilepath);
+  free(binaryFilepath);
+}
 
-    printf("Writing plate to %s\n", binaryFilepath);
-    writePlate(results[i].plate, binaryFilepath);
-    free(binaryFilepath);
-  }
+void openResultStream(ResultStream* stream, const JobData* jobsData,
+  const SimulationResult* results, size_t jobsCount) {
+  stream->file = openJobsResult(jobsData);
+  stream->jobsData = jobsData;
+  stream->results = results;
+  stream->jobsCount = jobsCount;
+  stream->nextLine = 0;
+  stream->isDone = calloc(jobsCount, 1);
+  assert(stream->isDone != NULL);
+}
 
-  free(jobNumbers);
-  free(path);
+void commitJobResult(ResultStream* stream, size_t jobIndex) {
+  // a worker, or every rank of a distributed job, already wrote the plate
+  if (stream->results[jobIndex].plate != NULL) {
+    writeResultPlate(stream->jobsData[jobIndex], stream->results[jobIndex]);
+  }
+  stream->isDone[jobIndex] = 1;
+  // a line waits until the lines of every previous job are written
+  while (stream->nextLine < stream->jobsCount
+    && stream->isDone[stream->nextLine]) {
+    writeJobResult(stream->jobsData[stream->nextLine],
+      stream->results[stream->nextLine], stream->file);
+    ++stream->nextLine;
+  }
+  fflush(stream->file);
+}
 
-  fclose(file);
+void closeResultStream(ResultStream* stream) {
+  fclose(stream->file);
+  free(stream->isDone);
 }
 
 
@@ -83,6 +132,11 @@ void writeJobResult(JobData jobData, SimulationResult result, FILE* file) {
   fprintf(file, "%.0f ", jobData.thermalDiffusivity);
   fprintf(file, "%.0f ", jobData.plateCellDimmensions);
   fprintf(file, "%.1f ", jobData.balancePoint);
+  if (result.isSteady) {
+    // an equilibrium has no time, its residual tells how close it is
+    fprintf(file, "%.6g\n", result.residual);
+    return;
+  }
   fprintf(file, "%zu ", result.iterations);
   const time_t seconds = result.iterations * jobData.duration;
     char formatted_time[48];
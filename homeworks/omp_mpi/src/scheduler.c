@@ -0,0 +1,243 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#include "scheduler.h"
+#include <assert.h>
+#include <math.h>
+#include <mpi.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "input.h"
+#include "output.h"
+#include "plate.h"
+#include "solution.h"
+
+/// Pi, strict C17 does not define M_PI
+#define SCHEDULER_PI 3.14159265358979323846
+
+/**
+ * @brief State of the main process while it hands out the jobs.
+ */
+typedef struct {
+    const JobData* jobsData;  /// < the jobs
+    SimulationResult* results;  /// < result of every job, in job order
+    size_t jobsCount;  /// < number of jobs
+    size_t* order;  /// < job indexes, the most expensive first
+    size_t nextJob;  /// < position in order of the next job to hand out
+    ResultStream stream;  /// < writes the results as they come
+    Arguments args;  /// < the arguments
+    pthread_mutex_t mutex;  /// < protects nextJob and the stream
+} JobScheduler;
+
+/**
+ * @brief A job message being sent to a worker, kept until it is delivered.
+ */
+typedef struct {
+    char* buffer;  /// < the packed job
+    MPI_Request request;  /// < the pending send
+} PendingJob;
+
+double estimateJobCost(const JobData* jobData, size_t rows, size_t cols) {
+  if (rows < 3 || cols < 3) {
+    return 0;
+  }
+  const double factor = (jobData->duration * jobData->thermalDiffusivity) /
+    (jobData->plateCellDimmensions * jobData->plateCellDimmensions);
+  const double decay = SCHEDULER_PI * SCHEDULER_PI * factor
+    * (1.0 / ((double) rows * rows) + 1.0 / ((double) cols * cols));
+  const double balancePoint = jobData->balancePoint > 0
+    ? jobData->balancePoint : 1e-12;
+  double iterations = decay > 0 ? log1p(1 / balancePoint) / decay : 1;
+  if (!(iterations >= 1)) {
+    iterations = 1;
+  }
+  return (double) (rows - 2) * (cols - 2) * iterations;
+}
+
+static double* jobCosts;  /// < costs seen by compareJobCosts while sorting
+
+static int compareJobCosts(const void* first, const void* second) {
+  const size_t a = *(const size_t*) first;
+  const size_t b = *(const size_t*) second;
+  if (jobCosts[a] != jobCosts[b]) {
+    return jobCosts[a] > jobCosts[b] ? -1 : 1;
+  }
+  // equal costs keep the order of the file
+  return a < b ? -1 : a > b;
+}
+
+// Orders the jobs longest first, a plate that cannot be read costs nothing,
+// its worker reports the error. A steady solve costs about its cells
+static size_t* orderJobs(const JobData* jobsData, size_t jobsCount,
+  SimulationMode mode) {
+  size_t* order = malloc(jobsCount * sizeof(size_t));
+  jobCosts = malloc(jobsCount * sizeof(double));
+  assert(order != NULL && jobCosts != NULL);
+  for (size_t i = 0; i < jobsCount; i++) {
+    size_t rows = 0;
+    size_t cols = 0;
+    order[i] = i;
+    if (!readPlateSize(jobsData[i].plateFile, jobsData[i].directory, &rows,
+      &cols)) {
+      jobCosts[i] = 0;
+    } else if (mode == MODE_STEADY) {
+      jobCosts[i] = (double) rows * cols;
+    } else {
+      jobCosts[i] = estimateJobCost(&jobsData[i], rows, cols);
+    }
+  }
+  qsort(order, jobsCount, sizeof(size_t), compareJobCosts);
+  free(jobCosts);
+  jobCosts = NULL;
+  return order;
+}
+
+// Takes the next job to hand out, returns 0 when there are no more
+static int takeNextJob(JobScheduler* scheduler, size_t* job) {
+  pthread_mutex_lock(&scheduler->mutex);
+  const int hasJob = scheduler->nextJob < scheduler->jobsCount;
+  if (hasJob) {
+    *job = scheduler->order[scheduler->nextJob++];
+  }
+  pthread_mutex_unlock(&scheduler->mutex);
+  return hasJob;
+}
+
+static void commitResult(JobScheduler* scheduler, SimulationResult result) {
+  pthread_mutex_lock(&scheduler->mutex);
+  scheduler->results[result.jobIndex] = result;
+  commitJobResult(&scheduler->stream, result.jobIndex);
+  scheduler->results[result.jobIndex].plate = NULL;
+  pthread_mutex_unlock(&scheduler->mutex);
+  // a worker wrote its plate and sent only the summary
+  if (result.plate != NULL) {
+    destroyPlate(result.plate);
+  }
+}
+
+// Runs jobs in the main process until none is left, makes no MPI calls
+static void* computeJobs(void* data) {
+  JobScheduler* scheduler = (JobScheduler*) data;
+  size_t job = 0;
+  while (takeNextJob(scheduler, &job)) {
+    SimulationResult result = processJob(scheduler->jobsData[job],
+      scheduler->args);
+    result.jobIndex = (int) job;
+    commitResult(scheduler, result);
+  }
+  return NULL;
+}
+
+// Sends a job without waiting for the worker to take it
+static void postJob(const JobScheduler* scheduler, size_t job, int worker,
+  PendingJob* pendingJobs, size_t* pendingCount) {
+  int size = 0;
+  PendingJob* pending = &pendingJobs[(*pendingCount)++];
+  pending->buffer = packJobData(&scheduler->jobsData[job], &size);
+  MPI_Isend(pending->buffer, size, MPI_PACKED, worker, JOB_MESSAGE_TAG,
+    MPI_COMM_WORLD, &pending->request);
+}
+
+static void stopWorker(int worker) {
+  int signal = 0;
+  sendJobData(NULL, worker);
+  MPI_Recv(&signal, 1, MPI_INT, worker, DISCONNECT_TAG, MPI_COMM_WORLD,
+    MPI_STATUS_IGNORE);
+}
+
+void runMainProcess(Arguments args, int processCount) {
+  JobScheduler scheduler;
+  size_t jobsCount = 0;
+  JobData* jobsData = readJobData(args.jobFile, &jobsCount);
+  // every worker runs its jobs with the threads given in the command line
+  for (size_t i = 0; i < jobsCount; i++) {
+    jobsData[i].threadCount = args.threadsCount;
+  }
+  scheduler.jobsData = jobsData;
+  scheduler.jobsCount = jobsCount;
+  scheduler.results = malloc(jobsCount * sizeof(SimulationResult));
+  assert(scheduler.results != NULL);
+  scheduler.order = orderJobs(jobsData, jobsCount, args.mode);
+  scheduler.nextJob = 0;
+  scheduler.args = args;
+  pthread_mutex_init(&scheduler.mutex, NULL);
+  // every result is written and freed as soon as it arrives
+  openResultStream(&scheduler.stream, jobsData, scheduler.results,
+    jobsCount);
+
+  // the biggest jobs go out first, one to every worker before the next round
+  const int workerCount = processCount - 1;
+  size_t* queuedJobs = calloc(processCount, sizeof(size_t));
+  PendingJob* pendingJobs = malloc(jobsCount * sizeof(PendingJob));
+  assert(queuedJobs != NULL && pendingJobs != NULL);
+  size_t pendingCount = 0;
+  size_t job = 0;
+  for (size_t round = 0; round < args.queueDepth; ++round) {
+    for (int worker = 1; worker <= workerCount
+      && takeNextJob(&scheduler, &job); ++worker) {
+      postJob(&scheduler, job, worker, pendingJobs, &pendingCount);
+      ++queuedJobs[worker];
+    }
+  }
+
+  // the thread starts after the first rounds, the workers get the
+  // biggest jobs
+  // the compute thread makes no MPI calls, the funneled level allows it
+  // beside this thread, which makes all of them
+  int threadLevel = MPI_THREAD_SINGLE;
+  MPI_Query_thread(&threadLevel);
+  const int canThread = threadLevel >= MPI_THREAD_FUNNELED;
+  if (!canThread && args.shouldMainCompute && workerCount > 0) {
+    fprintf(stderr, "Warning: mpi is not funneled, the main process will "
+      "not compute\n");
+  }
+  pthread_t computer;
+  const int isComputing = canThread
+    && (args.shouldMainCompute || workerCount == 0);
+  if (isComputing && pthread_create(&computer, NULL, computeJobs, &scheduler)
+    != EXIT_SUCCESS) {
+    fprintf(stderr, "Error: could not create the compute thread\n");
+    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+  }
+
+  int activeWorkers = 0;
+  for (int worker = 1; worker <= workerCount; ++worker) {
+    if (queuedJobs[worker] == 0) {
+      stopWorker(worker);
+    } else {
+      ++activeWorkers;
+    }
+  }
+  while (activeWorkers > 0) {
+    int worker = MPI_ANY_SOURCE;
+    SimulationResult result;
+    receiveJobResult(&result, MPI_ANY_SOURCE, &worker);
+    --queuedJobs[worker];
+    // the next job is queued before the TSV line is written
+    if (takeNextJob(&scheduler, &job)) {
+      postJob(&scheduler, job, worker, pendingJobs, &pendingCount);
+      ++queuedJobs[worker];
+    } else if (queuedJobs[worker] == 0) {
+      stopWorker(worker);
+      --activeWorkers;
+    }
+    commitResult(&scheduler, result);
+  }
+  if (isComputing) {
+    pthread_join(computer, NULL);
+  } else if (workerCount == 0) {
+    // no workers to wait for, this thread runs the jobs itself
+    computeJobs(&scheduler);
+  }
+
+  for (size_t i = 0; i < pendingCount; i++) {
+    MPI_Wait(&pendingJobs[i].request, MPI_STATUS_IGNORE);
+    free(pendingJobs[i].buffer);
+  }
+  closeResultStream(&scheduler.stream);
+  pthread_mutex_destroy(&scheduler.mutex);
+  free(pendingJobs);
+  free(queuedJobs);
+  free(scheduler.order);
+  free(scheduler.results);
+  destroyJobsData(jobsData);
+}
@@ -0,0 +1,39 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#pragma once
+#include <stddef.h>
+#include "types.h"
+
+/// Jobs sent to each worker ahead of its results, by default
+#define DEFAULT_QUEUE_DEPTH 2
+
+/**
+ * @brief Estimates the work of a job, to run the biggest jobs first.
+ *
+ * The cost is the interior cells times the iterations the slowest mode of
+ * the plate takes to decay to the balance point, pi^2 * factor * (1/rows^2
+ * + 1/cols^2) per iteration. Only the ranking of the jobs matters.
+ *
+ * @param jobData The job.
+ * @param rows The rows of the plate of the job.
+ * @param cols The columns of the plate of the job.
+ * @return The estimated cost, in cell updates.
+ */
+double estimateJobCost(const JobData* jobData, size_t rows, size_t cols);
+
+/**
+ * @brief Runs the main process: schedules the jobs and writes the TSV.
+ *
+ * The jobs are ordered by estimateJobCost, longest first, and handed out
+ * round-robin until every worker has queueDepth of them, so a worker finds
+ * its next job already waiting when it sends a result. Workers write their
+ * plates to the job directory and send only the iterations, which the main
+ * process puts in the TSV in job order. Each result is answered with the
+ * next job. With --main-computes, or without workers,
+ * a thread of the main process takes jobs from the same order. That thread
+ * makes no MPI calls, so it needs MPI_THREAD_FUNNELED; below that level the
+ * main process computes only when there are no workers, without a thread.
+ *
+ * @param args The arguments.
+ * @param processCount The number of processes, the main one included.
+ */
+void runMainProcess(Arguments args, int processCount);
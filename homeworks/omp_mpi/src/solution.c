@@ -3,15 +3,22 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <omp.h>
 // #include <mpi.h>
 
+#include "distributed.h"
 #include "input.h"
+#include "plate.h"
+#include "scheduler.h"
+#include "steady.h"
 #include "solution.h"
 #include "output.h"
 #include "MpiWrapper.h"
@@ -27,7 +34,9 @@ int main(int argc, char** argv) {
 
 
   Mpi mpi;
-  mpi_init(&mpi, &argc, &argv);
+  if (mpi_init(&mpi, &argc, &argv) != 0) {
+    return EXIT_FAILURE;
+  }
 
 
   int MAIN_PROCESS = 0;
@@ -35,67 +44,29 @@ int main(int argc, char** argv) {
   int REQUEST_NEWJOB = 2;
 
 
-  if (mpi.rank == MAIN_PROCESS) {
-    Arguments args = processArguments(argc, argv);
-    JobData* jobsData = readJobData(args.jobFile);
-    size_t jobsCount = calcFileLinesCount(args.jobFile);
-    SimulationResult* results = malloc(jobsCount * sizeof(SimulationResult));
-    size_t processedCount = 0;
-    int disconnectedCount = 0;
-
-    // distribute first jobs
-
-    for (int i = 1; i < mpi.size; i++) {
-      if (processedCount < jobsCount) {
-        bool shouldProcessAJob = true;
-        mpi_send(&shouldProcessAJob, 1, MPI_C_BOOL, i, 0);
-        sendJobData(&jobsData[processedCount], i);
-        processedCount++;
-      } else {
-        bool shouldProcessAJob = false;
-        mpi_send(&shouldProcessAJob, 1, MPI_C_BOOL, i, 0);
-        mpi_receive(&DISCONNECT_SIGNAL, 1, MPI_INT, i, 0, NULL);
-        disconnectedCount++;
-      }
-    }
-
-    // receive jobs results
-    while (disconnectedCount < (mpi.size - 1)) {
-      int* source = malloc(1 * sizeof(int));
-      SimulationResult result;
-      receiveJobResult(&result, MPI_ANY_SOURCE, source);
-      results[result.jobIndex] = result;
-      if (processedCount < jobsCount) {
-        bool shouldProcessAJob = true;
-        mpi_send(&shouldProcessAJob, 1, MPI_C_BOOL, *source, 0);
-        sendJobData(&jobsData[processedCount], *source);
-      } else {
-        bool shouldProcessAJob = false;
-        mpi_send(&shouldProcessAJob, 1, MPI_C_BOOL, *source, 0);
-        mpi_receive(&DISCONNECT_SIGNAL, 1, MPI_INT, *source, 0, NULL);
-        disconnectedCount++;
-      }
-
-      processedCount++;
-    }
-
-
-    writeJobsResult(jobsData, results, jobsCount, "output.txt");
-    destroyJobsData(jobsData, jobsCount);
-    destroySimulationResult(results, jobsCount);
+  // every process needs the options, e.g. the stencil kernel to use
+  Arguments args = processArguments(argc, argv);
 
+  if (args.isDistributed) {
+    // every process works on a block of each plate
+    runDistributedJobs(args, mpi.rank);
+  } else if (mpi.rank == MAIN_PROCESS) {
+    // the main process schedules the jobs, and may run some of them
+    runMainProcess(args, mpi.size);
   } else {
     while (true) {
-      bool shouldProcessAJob;
-      mpi_receive(&shouldProcessAJob, 1, MPI_C_BOOL, MAIN_PROCESS, 0, NULL);
-      if (shouldProcessAJob) {
-        JobData jobData;
-        receiveJobData(&jobData, MAIN_PROCESS);
-        SimulationResult result = processJob(jobData);
+      JobData jobData;
+      if (receiveJobData(&jobData, MAIN_PROCESS)) {
+        SimulationResult result = processJob(jobData, args);
         result.jobIndex = jobData.jobIndex;
+        // the plate goes to the shared directory, only its summary is sent
+        writeResultPlate(jobData, result);
+        destroyPlate(result.plate);
         sendJobResult(&result, MAIN_PROCESS);
+        free(jobData.plateFile);
       } else {
-        mpi_send(&DISCONNECT_SIGNAL, 1, MPI_INT, MAIN_PROCESS, 0);
+        mpi_send(&DISCONNECT_SIGNAL, 1, MPI_INT, MAIN_PROCESS,
+          DISCONNECT_TAG);
         break;
       }
     }
@@ -111,191 +82,269 @@ int main(int argc, char** argv) {
   return EXIT_SUCCESS;
 }
 
-void sendJobData(JobData* jobData, int dest) {
-    int plateFileLength = strlen(jobData->plateFile) + 1;
-    int directoryLength = strlen(jobData->directory) + 1;
-
-    mpi_send(&plateFileLength, 1, MPI_INT, dest, 0);
-    mpi_send(jobData->plateFile, plateFileLength, MPI_CHAR, dest, 1);
-    mpi_send(&directoryLength, 1, MPI_INT, dest, 2);
-    mpi_send(jobData->directory, directoryLength, MPI_CHAR, dest, 3);
-
-    mpi_send(&jobData->duration, 1, MPI_DOUBLE, dest, 4);
-    mpi_send(&jobData->thermalDiffusivity, 1, MPI_DOUBLE, dest, 5);
-    mpi_send(&jobData->plateCellDimmensions, 1, MPI_DOUBLE, dest, 6);
-    mpi_send(&jobData->balancePoint, 1, MPI_DOUBLE, dest, 7);
-    mpi_send(&jobData->threadCount, 1, MPI_INT, dest, 8);
-    mpi_send(&jobData->jobIndex, 1, MPI_INT, dest, 9);
-}
-
-void receiveJobData(JobData* jobData, int source) {
-  int plateFileLength, directoryLength;
-
-  mpi_receive(&plateFileLength, 1, MPI_INT, source, 0, NULL);
-  jobData->plateFile = (char*) malloc(plateFileLength);
-  mpi_receive(jobData->plateFile, plateFileLength, MPI_CHAR, source, 1, NULL);
-
-  mpi_receive(&directoryLength, 1, MPI_INT, source, 2, NULL);
-  jobData->directory = (char*) malloc(directoryLength);
-  mpi_receive(jobData->directory, directoryLength, MPI_CHAR, source, 3, NULL);
+char* packJobData(const JobData* jobData, int* packedSize) {
+  // the flag, the job index and the lengths of both strings, with the
+  // terminators; a stop message has only the flag set to zero
+  int header[4] = {jobData != NULL, 0, 0, 0};
+  uint64_t threadCount = 0;
+  double values[4] = {0, 0, 0, 0};
+  if (jobData != NULL) {
+    header[1] = jobData->jobIndex;
+    header[2] = strlen(jobData->plateFile) + 1;
+    header[3] = strlen(jobData->directory) + 1;
+    threadCount = jobData->threadCount;
+    values[0] = jobData->duration;
+    values[1] = jobData->thermalDiffusivity;
+    values[2] = jobData->plateCellDimmensions;
+    values[3] = jobData->balancePoint;
+  }
 
-  mpi_receive(&jobData->duration, 1, MPI_DOUBLE, source, 4, NULL);
-  mpi_receive(&jobData->thermalDiffusivity, 1, MPI_DOUBLE, source, 5, NULL);
-  mpi_receive(&jobData->plateCellDimmensions, 1, MPI_DOUBLE, source, 6, NULL);
-  mpi_receive(&jobData->balancePoint, 1, MPI_DOUBLE, source, 7, NULL);
-  mpi_receive(&jobData->threadCount, 1, MPI_DOUBLE, source, 8, NULL);
-  mpi_receive(&jobData->jobIndex, 1, MPI_INT, source, 9, NULL);
+  int size = 0;
+  int partSize = 0;
+  MPI_Pack_size(4, MPI_INT, MPI_COMM_WORLD, &partSize);
+  size += partSize;
+  MPI_Pack_size(1, MPI_UINT64_T, MPI_COMM_WORLD, &partSize);
+  size += partSize;
+  MPI_Pack_size(4, MPI_DOUBLE, MPI_COMM_WORLD, &partSize);
+  size += partSize;
+  MPI_Pack_size(header[2] + header[3], MPI_CHAR, MPI_COMM_WORLD, &partSize);
+  size += partSize;
+
+  char* buffer = malloc(size);
+  assert(buffer != NULL);
+  int position = 0;
+  MPI_Pack(header, 4, MPI_INT, buffer, size, &position, MPI_COMM_WORLD);
+  MPI_Pack(&threadCount, 1, MPI_UINT64_T, buffer, size, &position,
+    MPI_COMM_WORLD);
+  MPI_Pack(values, 4, MPI_DOUBLE, buffer, size, &position, MPI_COMM_WORLD);
+  if (jobData != NULL) {
+    MPI_Pack(jobData->plateFile, header[2], MPI_CHAR, buffer, size,
+      &position, MPI_COMM_WORLD);
+    MPI_Pack(jobData->directory, header[3], MPI_CHAR, buffer, size,
+      &position, MPI_COMM_WORLD);
+  }
+  *packedSize = position;
+  return buffer;
 }
 
-void sendJobResult(SimulationResult* result, int dest) {
-  size_t rows = result->plate->rows;
-  size_t cols = result->plate->cols;
+void sendJobData(const JobData* jobData, int dest) {
+  int size = 0;
+  char* buffer = packJobData(jobData, &size);
+  mpi_send(buffer, size, MPI_PACKED, dest, JOB_MESSAGE_TAG);
+  free(buffer);
+}
 
-  mpi_send(&rows, 1, MPI_INT, dest, 0);
-  mpi_send(&cols, 1, MPI_INT, dest, 1);
-  for (size_t i = 0; i < rows; i++) {
-    mpi_send(result->plate->data[i], cols, MPI_DOUBLE, dest, i + 2);
+bool receiveJobData(JobData* jobData, int source) {
+  // the size of the message depends on the strings
+  MPI_Status status;
+  int size = 0;
+  MPI_Probe(source, JOB_MESSAGE_TAG, MPI_COMM_WORLD, &status);
+  MPI_Get_count(&status, MPI_PACKED, &size);
+  char* buffer = malloc(size);
+  assert(buffer != NULL);
+  mpi_receive(buffer, size, MPI_PACKED, source, JOB_MESSAGE_TAG, NULL);
+
+  int position = 0;
+  int header[4];
+  MPI_Unpack(buffer, size, &position, header, 4, MPI_INT, MPI_COMM_WORLD);
+  if (header[0]) {
+    uint64_t threadCount = 0;
+    double values[4];
+    MPI_Unpack(buffer, size, &position, &threadCount, 1, MPI_UINT64_T,
+      MPI_COMM_WORLD);
+    MPI_Unpack(buffer, size, &position, values, 4, MPI_DOUBLE,
+      MPI_COMM_WORLD);
+    jobData->jobIndex = header[1];
+    jobData->threadCount = threadCount;
+    jobData->duration = values[0];
+    jobData->thermalDiffusivity = values[1];
+    jobData->plateCellDimmensions = values[2];
+    jobData->balancePoint = values[3];
+    // both strings in one block, freed with plateFile
+    jobData->plateFile = malloc(header[2] + header[3]);
+    assert(jobData->plateFile != NULL);
+    jobData->directory = jobData->plateFile + header[2];
+    MPI_Unpack(buffer, size, &position, jobData->plateFile, header[2],
+      MPI_CHAR, MPI_COMM_WORLD);
+    MPI_Unpack(buffer, size, &position, jobData->directory, header[3],
+      MPI_CHAR, MPI_COMM_WORLD);
   }
+  free(buffer);
+  return header[0];
+}
 
-
-
-  mpi_send(&result->iterations, 1, MPI_INT, dest, rows + 2);
-  mpi_send(&result->jobIndex, 1, MPI_INT, dest, rows + 3);
+void sendJobResult(const SimulationResult* result, int dest) {
+  uint64_t summary[RESULT_SIZE] = {(uint64_t) result->jobIndex,
+    result->iterations, (uint64_t) result->isSteady, 0};
+  // the residual goes bit by bit
+  memcpy(&summary[3], &result->residual, sizeof(double));
+  mpi_send(summary, RESULT_SIZE, MPI_UINT64_T, dest, RESULT_TAG);
 }
 
 void receiveJobResult(SimulationResult* result, int source, int* sourceCb) {
-  size_t rows = 0;
-  size_t cols = 0;
-
-  mpi_receive(&rows, 1, MPI_INT, source, 0, NULL);
-  mpi_receive(&cols, 1, MPI_INT, source, 1, NULL);
-
-  Plate* plate = malloc(sizeof(Plate));
-  plate->rows = rows;
-  plate->cols = cols;
-  plate->data = malloc(rows * sizeof(double*));
-  for (size_t i = 0; i < rows; i++) {
-    plate->data[i] = malloc(cols * sizeof(double));
-    mpi_receive(plate->data[i], cols, MPI_DOUBLE, source, i + 2, NULL);
+  uint64_t summary[RESULT_SIZE];
+  int sender = source;
+  mpi_receive(summary, RESULT_SIZE, MPI_UINT64_T, source, RESULT_TAG,
+    &sender);
+  result->jobIndex = (int) summary[0];
+  result->iterations = summary[1];
+  result->isSteady = (short) summary[2];
+  memcpy(&result->residual, &summary[3], sizeof(double));
+  result->plate = NULL;
+  if (sourceCb) {
+    *sourceCb = sender;
   }
-
-  result->plate = plate;
-
-  mpi_receive(&result->iterations, 1, MPI_INT, source, rows + 2, NULL);
-  mpi_receive(&result->jobIndex, 1, MPI_INT, source, rows + 3, sourceCb);
 }
 
 
 
-SimulationResult processJob(JobData jobData) {
+SimulationResult processJob(JobData jobData, Arguments args) {
   Plate* plate = readPlate(jobData.plateFile, jobData.directory);
-  SimulationResult result = simulate(jobData, plate);
+  if (args.mode == MODE_STEADY) {
+    return solveSteadyState(jobData, plate);
+  }
+  SimulationResult result = simulate(jobData, plate, args);
   // writeJobResult(jobData, result, stdout);
   return result;
 }
 
-SimulationResult simulate(JobData jobData, Plate* plate) {
-  Plate* readPlate = copyPlate(plate);
-  Plate* writePlate = plate;
-  const size_t totalCells = readPlate->rows * readPlate->cols;
+SimulationResult simulate(JobData jobData, Plate* plate, Arguments args) {
+  // both plates are filled by the threads that update them, see
+  // calcNewTemperature, the plate of the file is only read
+  const size_t stride = calcPlateStride(plate->cols);
+  const size_t totalCells = plate->rows * plate->cols;
   SharedData* sharedData = malloc(sizeof(SharedData));
-  sharedData->readPlate = readPlate;
-  sharedData->writePlate = writePlate;
+  sharedData->initialPlate = plate;
+  sharedData->readPlate = allocatePlate(plate->rows, plate->cols, stride);
+  sharedData->writePlate = allocatePlate(plate->rows, plate->cols, stride);
   sharedData->threadCount = jobData.threadCount > totalCells ? totalCells
     : jobData.threadCount;
   sharedData->jobData = jobData;
   sharedData->totalIterations = 0;
   sharedData->currentCell = 0;
+  sharedData->stencilKernel = args.stencilKernel;
 
   calcNewTemperature(sharedData);
 
 
 
+  // the last state is always in the write plate, which may be any of the two
   SimulationResult result;
-  result.plate = writePlate;
+  result.plate = sharedData->writePlate;
   result.iterations = sharedData->totalIterations + 1;
+  result.isSteady = 0;
+  result.residual = 0.0;
 
   // free memory
-  destroyPlate(readPlate);
+  destroyPlate(sharedData->readPlate);
+  destroyPlate(plate);
   free(sharedData);
   return result;
 }
 
+// Updates the rows of the calling thread, orphaned: the caller opens the
+// parallel region. The threads do not wait for each other at the end
+static double updatePlateRows(const Plate* readPlate, Plate* writePlate,
+  StencilRowFunction updateRow, double factor) {
+  const size_t rows = readPlate->rows;
+  const size_t cols = readPlate->cols;
+  const size_t stride = readPlate->stride;
+  double maxDelta = 0.0;
+  // static chunks give every thread the same rows on every iteration
+  #pragma omp for schedule(static) nowait
+  for (size_t row = 1; row < rows - 1; ++row) {
+    const double rowDelta = updateRow(readPlate->data + row * stride,
+      writePlate->data + row * stride, stride, 1, cols - 1, factor);
+    maxDelta = rowDelta > maxDelta ? rowDelta : maxDelta;
+  }
+  return maxDelta;
+}
+
 void calcNewTemperature(SharedData* sharedData) {
-    const JobData jobData = sharedData->jobData;
-    const double factor = (jobData.duration * jobData.thermalDiffusivity) /
-      (jobData.plateCellDimmensions * jobData.plateCellDimmensions);
+  const JobData jobData = sharedData->jobData;
+  const double factor = (jobData.duration * jobData.thermalDiffusivity) /
+    (jobData.plateCellDimmensions * jobData.plateCellDimmensions);
+  const StencilRowFunction updateRow = sharedData->stencilKernel.updateRow;
+  const size_t threadCount = sharedData->threadCount;
+
+  // maximum delta of every thread, on its own cache line, one array for
+  // even and one for odd iterations: a thread may write the next delta
+  // while a slower one still reads the previous ones
+  double* threadDeltas = calloc(2 * threadCount * DELTA_STRIDE,
+    sizeof(double));
+  assert(threadDeltas != NULL);
+
+  // one team for the whole job, OMP_PLACES chooses where it runs
+  #pragma omp parallel num_threads(threadCount) proc_bind(close)
+  {
+    const size_t thread = omp_get_thread_num();
+    const size_t teamSize = omp_get_num_threads();
+    // every thread swaps its own copy of the pointers, in the same way
+    Plate* readPlate = sharedData->readPlate;
+    Plate* writePlate = sharedData->writePlate;
+    size_t iterations = 0;
+
+    // first touch: every thread copies the rows it updates, the same static
+    // chunks as updatePlateRows, so their pages land on its NUMA node
+    const Plate* initialPlate = sharedData->initialPlate;
+    const size_t rows = initialPlate->rows;
+    #pragma omp single nowait
+    {
+      copyPlateRows(initialPlate, readPlate, 0, rows > 1 ? 1 : rows);
+      copyPlateRows(initialPlate, writePlate, 0, rows > 1 ? 1 : rows);
+      if (rows > 1) {
+        copyPlateRows(initialPlate, readPlate, rows - 1, rows);
+        copyPlateRows(initialPlate, writePlate, rows - 1, rows);
+      }
+    }
+    #pragma omp for schedule(static)
+    for (size_t row = 1; row < rows - 1; ++row) {
+      copyPlateRows(initialPlate, readPlate, row, row + 1);
+      copyPlateRows(initialPlate, writePlate, row, row + 1);
+    }
 
     while (1) {
-        double** currentPlateData = sharedData->readPlate->data;
-        double** newPlateData = sharedData->writePlate->data;
-        int isBalanced = 1;
-
-        if (sharedData->writePlate->isBalanced == 2) {
-            break;
-        }
-
-        const size_t rows = sharedData->readPlate->rows;
-        const size_t cols = sharedData->readPlate->cols;
-
-        #pragma omp parallel for reduction(&:isBalanced)
-        for (size_t row = 1; row < rows - 1; ++row) {
-            int localIsBalanced = 1;
-            for (size_t col = 1; col < cols - 1; ++col) {
-                double left = currentPlateData[row][col - 1];
-                double right = currentPlateData[row][col + 1];
-                double up = currentPlateData[row - 1][col];
-                double down = currentPlateData[row + 1][col];
-                double cell = currentPlateData[row][col];
-
-                double newTemperature = cell + factor *
-                  (left + right + up + down - 4 * cell);
-                newPlateData[row][col] = newTemperature;
-
-                if (fabs(newTemperature - cell) > jobData.balancePoint) {
-                    localIsBalanced = 0;  // No está balanceado
-                }
-            }
-            // Actualiza la variable isBalanced de manera segura
-            if (localIsBalanced == 0) {
-                isBalanced = 0;
-            }
-        }
-
-        // Actualizar el estado de balance de la placa
-        #pragma omp single
-        {
-            sharedData->writePlate->isBalanced = isBalanced ? 2 : 1;
-        }
+      double* deltas = threadDeltas + (iterations % 2) * threadCount
+        * DELTA_STRIDE;
+      deltas[thread * DELTA_STRIDE] = updatePlateRows(readPlate, writePlate,
+        updateRow, factor);
+      // the only synchronization of the iteration
+      #pragma omp barrier
+      // every thread reaches the same maximum, and the same decision
+      double maxDelta = 0.0;
+      for (size_t other = 0; other < teamSize; ++other) {
+        const double delta = deltas[other * DELTA_STRIDE];
+        maxDelta = delta > maxDelta ? delta : maxDelta;
+      }
+      if (maxDelta <= jobData.balancePoint) {
+        break;
+      }
+      Plate* temp = readPlate;
+      readPlate = writePlate;
+      writePlate = temp;
+      ++iterations;
+    }
 
-        // Intercambiar placas y actualizar iteraciones
-        #pragma omp single
-        {
-            if (!isBalanced) {
-                Plate* temp = sharedData->readPlate;
-                sharedData->readPlate = sharedData->writePlate;
-                sharedData->writePlate = temp;
-                sharedData->totalIterations++;
-            }
-        }
-        // Sincronizar los hilos antes de la siguiente iteración
-        #pragma omp barrier
+    // the last state is in the write plate
+    #pragma omp master
+    {
+      writePlate->isBalanced = 2;
+      sharedData->readPlate = readPlate;
+      sharedData->writePlate = writePlate;
+      sharedData->totalIterations = iterations;
     }
+  }
 
-    return;
+  free(threadDeltas);
 }
 
 
 Plate* copyPlate(Plate* plate) {
-  Plate* newPlate = malloc(sizeof(Plate));
-  newPlate->rows = plate->rows;
-  newPlate->cols = plate->cols;
+  Plate* newPlate = createPlateStrided(plate->rows, plate->cols,
+    plate->stride);
   newPlate->isBalanced = plate->isBalanced;
-  newPlate->data = malloc(newPlate->rows * sizeof(double*));
-  for (size_t i = 0; i < newPlate->rows; i++) {
-    newPlate->data[i] = malloc(newPlate->cols * sizeof(double));
-    memcpy(newPlate->data[i], plate->data[i], newPlate->cols * sizeof(double));
-  }
+  memcpy(newPlate->data, plate->data,
+    plate->rows * plate->stride * sizeof(double));
   return newPlate;
 }
 
@@ -319,25 +368,25 @@ void format_time(time_t seconds, char *buffer, size_t buffer_size) {
       months, days, hours, minutes, secs);
 }
 
-void destroyJobsData(JobData *jobsData, size_t jobsCount) {
-    for (size_t i = 0; i < jobsCount; i++) {
-        free(jobsData[i].plateFile);
-        free(jobsData[i].directory);
-    }
+void destroyJobsData(JobData *jobsData) {
+    // the strings of the jobs are in the same block
     free(jobsData);
 }
 
 void destroyPlate(Plate* plate) {
-  for (size_t i = 0; i < plate->rows; i++) {
-    free(plate->data[i]);
+  if (plate->mappedSize > 0) {
+    munmap((char*) plate->data - PLATE_HEADER_SIZE, plate->mappedSize);
+  } else {
+    free(plate->data);
   }
-  free(plate->data);
   free(plate);
 }
 
 void destroySimulationResult(SimulationResult* results, size_t resultsCount) {
     for (size_t i = 0; i < resultsCount; i++) {
-        destroyPlate(results[i].plate);
+        if (results[i].plate != NULL) {
+            destroyPlate(results[i].plate);
+        }
     }
     free(results);
 }
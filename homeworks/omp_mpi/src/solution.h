@@ -1,6 +1,7 @@
 // Copyright [2024] <Aaron Santana Valdelomar>
 
 #pragma once
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "types.h"
@@ -15,17 +16,17 @@
  * @param args The arguments for the simulation.
  * @return The result of the job processing.
  */
-SimulationResult processJob(JobData jobData);
+SimulationResult processJob(JobData jobData, Arguments args);
 
 /**
  * Simulates the given job data on the specified plate.
  *
  * @param jobData The job data to be simulated.
- * @param plate The plate on which the simulation will be performed.
+ * @param plate The initial plate, freed by the simulation.
  * @param args The arguments for the simulation.
  * @return The result of the simulation.
  */
-SimulationResult simulate(JobData jobData, Plate* plate);
+SimulationResult simulate(JobData jobData, Plate* plate, Arguments args);
 
 /**
  * @brief Creates a copy of a Plate object.
@@ -50,11 +51,18 @@ void copyPlateBorders(Plate original, Plate copy);
 
 
 
+/// Doubles between the deltas of two threads, a cache line apart
+#define DELTA_STRIDE 8
+
 /**
  * Calculates the new temperature based on the given data.
  *
- * @param data The data needed to calculate the new temperature.
- * @return A pointer to the calculated new temperature.
+ * One parallel region runs every iteration of the job. The threads keep
+ * their rows from one iteration to the next, publish their maximum delta
+ * and meet at a single barrier per iteration, after which every thread
+ * decides on its own whether the plate is balanced.
+ *
+ * @param sharedData The job, receives the final plates and iterations.
  */
 void calcNewTemperature(SharedData* sharedData);
 
@@ -63,14 +71,11 @@ void calcNewTemperature(SharedData* sharedData);
  * @brief Destroys the JobData array and frees the memory.
  *
  * This function is responsible for deallocating the memory used by the JobData array.
- * It takes a pointer to the JobData array and the number of jobs as parameters.
- * The function frees the memory allocated for each JobData element and then frees the memory
- * allocated for the JobData array itself.
+ * The array and the strings of its jobs are a single block.
  *
- * @param jobsData Pointer to the JobData array.
- * @param jobsCount Number of jobs in the array.
+ * @param jobsData Pointer to the JobData array, as returned by readJobData.
  */
-void destroyJobsData(JobData *jobsData, size_t jobsCount);
+void destroyJobsData(JobData *jobsData);
 /**
  * @brief Destroys a Plate object.
  *
@@ -116,8 +121,66 @@ struct private_data* create_threads(size_t thread_count,
 int join_threads(const size_t thread_count, struct private_data* team);
 
 
-void sendJobData(JobData* jobData, int dest);
-void receiveJobData(JobData* jobData, int source);
+/// Tag of the job messages, the only ones sent by the main process
+#define JOB_MESSAGE_TAG 10
+
+/// Tag of the message a worker sends back when it stops
+#define DISCONNECT_TAG 0
+
+/**
+ * @brief Packs a job into the message sent by sendJobData.
+ *
+ * @param jobData The job, or NULL for a stop message.
+ * @param packedSize Receives the size of the message in bytes.
+ * @return The message, freed by the caller.
+ */
+char* packJobData(const JobData* jobData, int* packedSize);
 
-void sendJobResult(SimulationResult* result, int dest);
+/**
+ * @brief Sends a job to a worker in a single packed message.
+ *
+ * The message holds a flag, the index, the thread count, the four
+ * parameters and both strings of the job, packed with MPI_Pack.
+ *
+ * @param jobData The job, or NULL to tell the worker to stop.
+ * @param dest The rank of the worker.
+ */
+void sendJobData(const JobData* jobData, int dest);
+
+/**
+ * @brief Receives the next message sent by sendJobData.
+ *
+ * @param jobData Receives the job. Its strings are one block, freed with
+ * free(jobData->plateFile).
+ * @param source The rank of the main process.
+ * @return true if a job was received, false if the worker must stop.
+ */
+bool receiveJobData(JobData* jobData, int source);
+
+/// Tag of the result summaries: job index, iterations, steady flag and
+/// residual
+#define RESULT_TAG 11
+/// Number of integers in a result summary
+#define RESULT_SIZE 4
+
+/**
+ * @brief Sends the summary of a finished job to the main process.
+ *
+ * The worker writes the plate of the result itself. Only the job index,
+ * the iterations, the steady flag and the residual go to the main process,
+ * as 64-bit integers, the residual with its bits.
+ *
+ * @param result The result.
+ * @param dest The rank of the main process.
+ */
+void sendJobResult(const SimulationResult* result, int dest);
+
+/**
+ * @brief Receives a summary sent by sendJobResult.
+ *
+ * @param result Receives the summary, the plate is NULL because the worker
+ * already wrote it.
+ * @param source The rank of the worker, or MPI_ANY_SOURCE.
+ * @param sourceCb Receives the rank of the worker, if not NULL.
+ */
 void receiveJobResult(SimulationResult* result, int source, int* sourceCb);
@@ -0,0 +1,290 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#include "steady.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "plate.h"
+#include "solution.h"
+
+/**
+ * @brief A grid of the multigrid hierarchy.
+ *
+ * The interior cells are surrounded by a ring of zeros, the borders of the
+ * plate are fixed, so a correction is zero on them.
+ */
+typedef struct {
+    size_t rows;  /// < interior rows
+    size_t cols;  /// < interior columns
+    size_t stride;  /// < cols plus the two borders
+    size_t threads;  /// < threads of the loops, 1 on small grids
+    double* solution;  /// < correction being solved
+    double* rhs;  /// < right hand side
+    double* residual;  /// < rhs minus the operator applied to the solution
+} GridLevel;
+
+/// Cell (row, col) of a grid array, borders included in the indexes
+#define GRID_CELL(grid, array, row, col) \
+  ((grid)->array[(row) * (grid)->stride + (col)])
+
+static double* createGridArray(size_t rows, size_t cols) {
+  double* array = calloc((rows + 2) * (cols + 2), sizeof(double));
+  if (array == NULL) {
+    fprintf(stderr, "Error: could not allocate a %zux%zu grid\n", rows, cols);
+    exit(EXIT_FAILURE);
+  }
+  return array;
+}
+
+static void initGridLevel(GridLevel* grid, size_t rows, size_t cols,
+  size_t threads) {
+  grid->rows = rows;
+  grid->cols = cols;
+  grid->stride = cols + 2;
+  grid->threads = rows * cols >= STEADY_PARALLEL_CELLS ? threads : 1;
+  grid->solution = createGridArray(rows, cols);
+  grid->rhs = createGridArray(rows, cols);
+  grid->residual = createGridArray(rows, cols);
+}
+
+static void destroyGridLevel(GridLevel* grid) {
+  free(grid->solution);
+  free(grid->rhs);
+  free(grid->residual);
+}
+
+// Updates the cells whose row plus col has the parity of color
+static void smoothColor(GridLevel* grid, size_t color) {
+  #pragma omp parallel for num_threads(grid->threads) schedule(static)
+  for (size_t row = 1; row <= grid->rows; ++row) {
+    double* cell = &GRID_CELL(grid, solution, row, 0);
+    const double* rhs = &GRID_CELL(grid, rhs, row, 0);
+    for (size_t col = 1 + ((row + 1 + color) & 1); col <= grid->cols;
+      col += 2) {
+      cell[col] = 0.25 * (rhs[col] + cell[col - 1] + cell[col + 1]
+        + cell[col - grid->stride] + cell[col + grid->stride]);
+    }
+  }
+}
+
+static void computeResidual(GridLevel* grid) {
+  #pragma omp parallel for num_threads(grid->threads) schedule(static)
+  for (size_t row = 1; row <= grid->rows; ++row) {
+    const double* cell = &GRID_CELL(grid, solution, row, 0);
+    const double* rhs = &GRID_CELL(grid, rhs, row, 0);
+    double* residual = &GRID_CELL(grid, residual, row, 0);
+    for (size_t col = 1; col <= grid->cols; ++col) {
+      residual[col] = rhs[col] - 4 * cell[col] + cell[col - 1]
+        + cell[col + 1] + cell[col - grid->stride] + cell[col + grid->stride];
+    }
+  }
+}
+
+// Coarse cell (row, col) sits on fine cell (2 row, 2 col), the transpose of
+// prolongCorrection, so the V-cycle stays symmetric
+static void restrictResidual(const GridLevel* fine, GridLevel* coarse) {
+  #pragma omp parallel for num_threads(fine->threads) schedule(static)
+  for (size_t row = 1; row <= coarse->rows; ++row) {
+    for (size_t col = 1; col <= coarse->cols; ++col) {
+      const double* center = &GRID_CELL(fine, residual, 2 * row, 2 * col);
+      const double* up = center - fine->stride;
+      const double* down = center + fine->stride;
+      GRID_CELL(coarse, rhs, row, col) = center[0]
+        + 0.5 * (center[-1] + center[1] + up[0] + down[0])
+        + 0.25 * (up[-1] + up[1] + down[-1] + down[1]);
+    }
+  }
+}
+
+// A fine cell of even index lies on a coarse cell, an odd one between two,
+// row / 2 and (row + 1) / 2 name both cases at once
+static void prolongCorrection(const GridLevel* coarse, GridLevel* fine) {
+  #pragma omp parallel for num_threads(fine->threads) schedule(static)
+  for (size_t row = 1; row <= fine->rows; ++row) {
+    const double* above = &GRID_CELL(coarse, solution, row / 2, 0);
+    const double* below = &GRID_CELL(coarse, solution, (row + 1) / 2, 0);
+    double* cell = &GRID_CELL(fine, solution, row, 0);
+    for (size_t col = 1; col <= fine->cols; ++col) {
+      const size_t left = col / 2;
+      const size_t right = (col + 1) / 2;
+      cell[col] += 0.25 * (above[left] + above[right] + below[left]
+        + below[right]);
+    }
+  }
+}
+
+static void clearSolution(GridLevel* grid) {
+  #pragma omp parallel for num_threads(grid->threads) schedule(static)
+  for (size_t row = 1; row <= grid->rows; ++row) {
+    memset(&GRID_CELL(grid, solution, row, 1), 0,
+      grid->cols * sizeof(double));
+  }
+}
+
+// Approximates the inverse of the operator on the rhs of the first level,
+// from a zero guess, a fixed symmetric linear map as PCG needs
+static void runVCycle(GridLevel* levels, size_t level, size_t levelCount) {
+  GridLevel* grid = &levels[level];
+  clearSolution(grid);
+  if (level + 1 == levelCount) {
+    for (size_t sweep = 0; sweep < STEADY_COARSE_SWEEPS; ++sweep) {
+      smoothColor(grid, 0);
+      smoothColor(grid, 1);
+      smoothColor(grid, 1);
+      smoothColor(grid, 0);
+    }
+    return;
+  }
+  smoothColor(grid, 0);
+  smoothColor(grid, 1);
+  computeResidual(grid);
+  restrictResidual(grid, &levels[level + 1]);
+  runVCycle(levels, level + 1, levelCount);
+  prolongCorrection(&levels[level + 1], grid);
+  // the colors in reverse, the transpose of the first smoothing
+  smoothColor(grid, 1);
+  smoothColor(grid, 0);
+}
+
+// Applies the 5-point operator, 4 cell minus the neighbours, on a grid
+// array with zero borders
+static void applyOperator(const GridLevel* grid, const double* input,
+  double* output) {
+  const size_t stride = grid->stride;
+  #pragma omp parallel for num_threads(grid->threads) schedule(static)
+  for (size_t row = 1; row <= grid->rows; ++row) {
+    const double* cell = input + row * stride;
+    double* result = output + row * stride;
+    for (size_t col = 1; col <= grid->cols; ++col) {
+      result[col] = 4 * cell[col] - cell[col - 1] - cell[col + 1]
+        - cell[col - stride] - cell[col + stride];
+    }
+  }
+}
+
+static double dotGrid(const GridLevel* grid, const double* first,
+  const double* second) {
+  double dot = 0.0;
+  #pragma omp parallel for num_threads(grid->threads) schedule(static) \
+    reduction(+:dot)
+  for (size_t row = 1; row <= grid->rows; ++row) {
+    for (size_t col = 1; col <= grid->cols; ++col) {
+      dot += first[row * grid->stride + col] * second[row * grid->stride
+        + col];
+    }
+  }
+  return dot;
+}
+
+static double maxAbsGrid(const GridLevel* grid, const double* array) {
+  double maxValue = 0.0;
+  #pragma omp parallel for num_threads(grid->threads) schedule(static) \
+    reduction(max:maxValue)
+  for (size_t row = 1; row <= grid->rows; ++row) {
+    for (size_t col = 1; col <= grid->cols; ++col) {
+      const double value = fabs(array[row * grid->stride + col]);
+      maxValue = value > maxValue ? value : maxValue;
+    }
+  }
+  return maxValue;
+}
+
+// Writes the residual of the plate, its neighbours minus 4 cell, on the
+// interior of a grid array
+static void computePlateResidual(const GridLevel* grid, const Plate* plate,
+  double* residual) {
+  const size_t stride = plate->stride;
+  #pragma omp parallel for num_threads(grid->threads) schedule(static)
+  for (size_t row = 1; row <= grid->rows; ++row) {
+    const double* cell = PLATE_ROW(plate, row);
+    for (size_t col = 1; col <= grid->cols; ++col) {
+      residual[row * grid->stride + col] = cell[col - 1] + cell[col + 1]
+        + cell[col - stride] + cell[col + stride] - 4 * cell[col];
+    }
+  }
+}
+
+SimulationResult solveSteadyState(JobData jobData, Plate* plate) {
+  SimulationResult result;
+  result.plate = createPlate(plate->rows, plate->cols);
+  result.iterations = 0;
+  result.residual = 0.0;
+  result.isSteady = 1;
+  copyPlateRows(plate, result.plate, 0, plate->rows);
+  destroyPlate(plate);
+  if (result.plate->rows < 3 || result.plate->cols < 3) {
+    return result;
+  }
+  Plate* solution = result.plate;
+  const double factor = (jobData.duration * jobData.thermalDiffusivity) /
+    (jobData.plateCellDimmensions * jobData.plateCellDimmensions);
+  const size_t threads = jobData.threadCount > 0 ? jobData.threadCount : 1;
+
+  // every level halves the sides of the previous one
+  GridLevel levels[STEADY_MAX_LEVELS];
+  size_t levelCount = 1;
+  initGridLevel(&levels[0], solution->rows - 2, solution->cols - 2, threads);
+  while (levelCount < STEADY_MAX_LEVELS && levels[levelCount - 1].rows >= 4
+    && levels[levelCount - 1].cols >= 4) {
+    initGridLevel(&levels[levelCount], levels[levelCount - 1].rows / 2,
+      levels[levelCount - 1].cols / 2, threads);
+    ++levelCount;
+  }
+
+  // PCG on the correction of the plate: the residual goes in the rhs of the
+  // first level and the V-cycle leaves the preconditioned one in its solution
+  GridLevel* grid = &levels[0];
+  double* correction = createGridArray(grid->rows, grid->cols);
+  double* direction = createGridArray(grid->rows, grid->cols);
+  double* product = createGridArray(grid->rows, grid->cols);
+  double* residual = grid->rhs;
+  computePlateResidual(grid, solution, residual);
+  const double initialResidual = maxAbsGrid(grid, residual);
+  double tolerance = initialResidual * STEADY_RELATIVE_TOLERANCE;
+  if (factor > 0 && jobData.balancePoint / factor > tolerance) {
+    tolerance = jobData.balancePoint / factor;
+  }
+
+  double residualNorm = initialResidual;
+  double rho = 0.0;
+  while (residualNorm > tolerance
+    && result.iterations < STEADY_MAX_ITERATIONS) {
+    runVCycle(levels, 0, levelCount);
+    const double nextRho = dotGrid(grid, residual, grid->solution);
+    const double beta = result.iterations == 0 ? 0.0 : nextRho / rho;
+    rho = nextRho;
+    const size_t cells = (grid->rows + 2) * grid->stride;
+    #pragma omp parallel for num_threads(grid->threads) schedule(static)
+    for (size_t cell = 0; cell < cells; ++cell) {
+      direction[cell] = grid->solution[cell] + beta * direction[cell];
+    }
+    applyOperator(grid, direction, product);
+    const double alpha = rho / dotGrid(grid, direction, product);
+    #pragma omp parallel for num_threads(grid->threads) schedule(static)
+    for (size_t cell = 0; cell < cells; ++cell) {
+      correction[cell] += alpha * direction[cell];
+      residual[cell] -= alpha * product[cell];
+    }
+    residualNorm = maxAbsGrid(grid, residual);
+    ++result.iterations;
+  }
+
+  for (size_t row = 1; row <= grid->rows; ++row) {
+    double* cell = PLATE_ROW(solution, row);
+    for (size_t col = 1; col <= grid->cols; ++col) {
+      cell[col] += correction[row * grid->stride + col];
+    }
+  }
+  // the residual of the plate itself, the recurrence drifts from it
+  computePlateResidual(grid, solution, residual);
+  result.residual = factor * maxAbsGrid(grid, residual);
+
+  free(correction);
+  free(direction);
+  free(product);
+  for (size_t level = 0; level < levelCount; ++level) {
+    destroyGridLevel(&levels[level]);
+  }
+  return result;
+}
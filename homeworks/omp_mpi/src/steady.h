@@ -0,0 +1,38 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#pragma once
+#include <stddef.h>
+#include "types.h"
+
+/// Most PCG iterations of a steady solve, it usually needs a few dozen
+#define STEADY_MAX_ITERATIONS 10000
+/// Smallest residual reduction asked of a steady solve, for balance points
+/// too small for the precision of the plate
+#define STEADY_RELATIVE_TOLERANCE 1e-12
+/// Levels of the multigrid hierarchy, at most
+#define STEADY_MAX_LEVELS 32
+/// Symmetric sweeps of the smoother on the coarsest grid
+#define STEADY_COARSE_SWEEPS 16
+/// Cells of a grid worth running its loops in parallel
+#define STEADY_PARALLEL_CELLS (16 * 1024)
+
+/**
+ * @brief Solves the equilibrium temperature of a plate.
+ *
+ * Instead of stepping in time, solves the discrete Laplace equation of the
+ * interior with the borders of the plate fixed, with conjugate gradients
+ * preconditioned by a geometric multigrid V-cycle: red-black Gauss-Seidel
+ * smoothing, full weighting restriction and bilinear interpolation, on
+ * grids halved until a side is shorter than 4 cells. The work grows about
+ * linearly with the cells, instead of the iterations of the time steps.
+ *
+ * The solve stops when an explicit step of the job would change no cell by
+ * more than the balance point, or when the residual dropped by
+ * STEADY_RELATIVE_TOLERANCE. The loops run on jobData.threadCount threads.
+ *
+ * @param jobData The job.
+ * @param plate The initial plate, its borders stay fixed, freed by the
+ * solve.
+ * @return The result, iterations counts the PCG iterations and residual is
+ * the biggest change an explicit step would still make.
+ */
+SimulationResult solveSteadyState(JobData jobData, Plate* plate);
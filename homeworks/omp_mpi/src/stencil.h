@@ -0,0 +1,43 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#pragma once
+#include <stddef.h>
+
+/**
+ * @brief Updates a segment of one plate row with the 5-point stencil.
+ *
+ * Computes next[col] = cell + factor * (left + right + up + down - 4 * cell)
+ * for every col in [startCol, endCol), where the neighbours are read from
+ * current, current - stride and current + stride.
+ *
+ * @param current First cell of the row in the read plate.
+ * @param next First cell of the same row in the write plate.
+ * @param stride Distance in doubles between two consecutive rows.
+ * @param startCol First column to update.
+ * @param endCol Column after the last one to update.
+ * @param factor Constant part of the heat transfer formula.
+ * @return The biggest absolute temperature change in the segment.
+ */
+typedef double (*StencilRowFunction)(const double* current, double* next,
+  size_t stride, size_t startCol, size_t endCol, double factor);
+
+/**
+ * @struct StencilKernel
+ * @brief A stencil row function and the instruction set it is written for.
+ */
+typedef struct {
+    const char* name;  /// < name of the instruction set, e.g. "avx2"
+    StencilRowFunction updateRow;  /// < NULL if the kernel is not available
+} StencilKernel;
+
+/**
+ * @brief Finds a stencil kernel that runs on this CPU.
+ *
+ * The CPU is probed with CPUID. When name is NULL the widest supported
+ * kernel is returned (avx512, avx2, sse2 or scalar). Otherwise the kernel
+ * with that name is returned, with a NULL function if it is unknown or the
+ * CPU does not support it.
+ *
+ * @param name The name of the wanted kernel, or NULL for the best one.
+ * @return The selected kernel.
+ */
+StencilKernel findStencilKernel(const char* name);
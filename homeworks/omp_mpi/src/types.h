@@ -4,19 +4,37 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include "stencil.h"
 
 
 /**
  * @brief Structure representing a plate with data, number of rows, and number of columns.
+ *
+ * Cell (row, col) is stored at data[row * stride + col]. Allocated plates
+ * keep their cells in one 64-byte aligned buffer with padded rows. A plate
+ * loaded with mmap points into the file mapping, right after the header,
+ * so it is only 8-byte aligned and its stride is cols.
  */
 
 typedef struct  {
-    double** data;  /// < matrix of doubles representing the plate
+    double* data;  /// < row-major cells, 64-byte aligned unless mapped
+        /// from a file
     short isBalanced;  /// < indicates if the plate is balanced
     size_t rows;  /// < number of rows in the plate
     size_t cols;  /// < number of columns in the plate
+    size_t stride;  /// < row length in doubles, padded unless mapped
+        /// from a file, where it equals cols
+    size_t mappedSize;  /// < bytes of the mapped file, 0 if data is allocated
 } Plate;
 
+/**
+ * @brief What a job computes.
+ */
+typedef enum {
+  MODE_TRANSIENT,  /// < time steps until the plate is balanced
+  MODE_STEADY  /// < the equilibrium of the plate, solved directly
+} SimulationMode;
+
 /**
  * @struct Arguments
  * @brief Represents the arguments of the program such as the job file path and the number of threads.
@@ -28,6 +46,12 @@ typedef struct {
     size_t threadsCount;  /// < number of threads to be used
     short isVerbose;  /// < indicates if the program should print verbose output
     short shloudPrintIterations;  /// < indicates if the program
+    StencilKernel stencilKernel;  /// < kernel used to update the plate rows
+    short isDistributed;  /// < indicates every plate is split among the
+        /// processes instead of giving a job to every process
+    size_t queueDepth;  /// < jobs handed to a worker ahead of its results
+    short shouldMainCompute;  /// < indicates the main process runs jobs too
+    SimulationMode mode;  /// < what every job computes
 } Arguments;
 
 /**
@@ -58,6 +82,9 @@ typedef struct {
     Plate* plate;  /// < plate resulting from the simulation
     size_t iterations;  /// < number of iterations performed in the simulation
     int jobIndex;  /// < index of the job
+    short isSteady;  /// < indicates the plate is a steady state solution
+    double residual;  /// < biggest change a time step would still make on
+        /// a steady solution, unused otherwise
 } SimulationResult;
 
 /**
@@ -69,10 +96,13 @@ typedef struct {
  */
 typedef struct {
     size_t threadCount;  /// < number of threads
+    const Plate* initialPlate;  /// < plate of the file, copied to both
+        /// plates by the threads that update them
     Plate* readPlate;  /// < current plate
     Plate* writePlate;  /// < new plate
     JobData jobData;  /// < job data
     size_t totalIterations;  /// < total number of iterations
+    StencilKernel stencilKernel;  /// < kernel used to update the plate rows
     size_t currentCell;  /// < current cell being processed
 } SharedData;
 
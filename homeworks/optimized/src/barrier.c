@@ -0,0 +1,89 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#define _GNU_SOURCE
+#include "barrier.h"
+#include <sched.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+static void sleepOnSense(atomic_int* sense, int oldSense) {
+#ifdef __linux__
+  syscall(SYS_futex, (int*) sense, FUTEX_WAIT_PRIVATE, oldSense, NULL, NULL,
+    0);
+#else
+  (void) sense;
+  (void) oldSense;
+  sched_yield();
+#endif
+}
+
+static void wakeOnSense(atomic_int* sense) {
+#ifdef __linux__
+  syscall(SYS_futex, (int*) sense, FUTEX_WAKE_PRIVATE, __INT_MAX__, NULL,
+    NULL, 0);
+#else
+  (void) sense;
+#endif
+}
+
+static inline void cpuRelax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+void initBarrier(Barrier* barrier, size_t threadCount) {
+  atomic_init(&barrier->remaining, threadCount);
+  atomic_init(&barrier->sense, 0);
+  atomic_init(&barrier->isReduced, 1);
+  atomic_init(&barrier->sleepers, 0);
+  barrier->result = 0;
+  barrier->threadCount = threadCount;
+  const long processors = sysconf(_SC_NPROCESSORS_ONLN);
+  barrier->spinCount = processors > 0 && (size_t) processors >= threadCount
+    ? BARRIER_SPIN_COUNT : 0;
+}
+
+int waitBarrier(Barrier* barrier, int* sense, int value,
+  BarrierAction action, void* data) {
+  const int oldSense = *sense;
+  *sense = !oldSense;
+  if (!value) {
+    atomic_store_explicit(&barrier->isReduced, 0, memory_order_relaxed);
+  }
+
+  if (atomic_fetch_sub_explicit(&barrier->remaining, 1,
+    memory_order_acq_rel) == 1) {
+    // el último hilo reduce, ejecuta la acción y prepara el siguiente episodio
+    const int isReduced = atomic_load_explicit(&barrier->isReduced,
+      memory_order_relaxed);
+    barrier->result = action ? action(data, isReduced) : isReduced;
+    atomic_store_explicit(&barrier->isReduced, 1, memory_order_relaxed);
+    atomic_store_explicit(&barrier->remaining, barrier->threadCount,
+      memory_order_relaxed);
+    // publica todo lo anterior y libera a los demás hilos
+    atomic_store(&barrier->sense, !oldSense);
+    if (atomic_load(&barrier->sleepers) > 0) {
+      wakeOnSense(&barrier->sense);
+    }
+    return barrier->result;
+  }
+
+  for (size_t spin = 0; spin < barrier->spinCount; ++spin) {
+    if (atomic_load_explicit(&barrier->sense, memory_order_acquire)
+      != oldSense) {
+      return barrier->result;
+    }
+    cpuRelax();
+  }
+
+  atomic_fetch_add(&barrier->sleepers, 1);
+  while (atomic_load(&barrier->sense) == oldSense) {
+    sleepOnSense(&barrier->sense, oldSense);
+  }
+  atomic_fetch_sub(&barrier->sleepers, 1);
+  return barrier->result;
+}
@@ -0,0 +1,62 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#pragma once
+#include <stdatomic.h>
+#include <stddef.h>
+
+/// Polls of the sense flag before a waiting thread sleeps in the kernel
+#define BARRIER_SPIN_COUNT 4096
+
+/**
+ * @brief Routine run by the last thread that reaches a barrier.
+ *
+ * @param data The data given to waitBarrier.
+ * @param isReduced The AND of the values given by every thread.
+ * @return The result of the episode, returned to every thread.
+ */
+typedef int (*BarrierAction)(void* data, int isReduced);
+
+/**
+ * @struct Barrier
+ * @brief Reusable sense-reversing barrier that AND-reduces one value.
+ *
+ * Threads count down with an atomic and the last one flips the sense flag,
+ * so an episode costs one atomic per thread. Waiting threads spin on the
+ * flag for a while and then sleep on it with a futex.
+ */
+typedef struct {
+    atomic_size_t remaining;  /// < threads that have not arrived yet
+    atomic_int sense;  /// < flipped by the last thread of every episode
+    atomic_int isReduced;  /// < AND of the values given so far
+    atomic_int sleepers;  /// < threads sleeping on the sense flag
+    int result;  /// < result of the last episode
+    size_t threadCount;  /// < threads that take part in every episode
+    size_t spinCount;  /// < polls before sleeping, 0 if oversubscribed
+} Barrier;
+
+/**
+ * @brief Initializes a barrier for a team of threads.
+ *
+ * Spinning is disabled when there are more threads than online processors,
+ * since a spinning thread would only delay the one it waits for.
+ *
+ * @param barrier The barrier to initialize.
+ * @param threadCount The number of threads of the team.
+ */
+void initBarrier(Barrier* barrier, size_t threadCount);
+
+/**
+ * @brief Waits until every thread of the team reaches the barrier.
+ *
+ * The last thread that arrives runs action with the AND of every value
+ * before any thread is released. Each thread keeps its own sense, which
+ * must start at 0.
+ *
+ * @param barrier The barrier.
+ * @param sense The sense of the calling thread, flipped on every episode.
+ * @param value The value of the calling thread for the AND-reduction.
+ * @param action Routine run once per episode, NULL to return the AND.
+ * @param data The data given to action.
+ * @return The value returned by action, the same for every thread.
+ */
+int waitBarrier(Barrier* barrier, int* sense, int value,
+  BarrierAction action, void* data);
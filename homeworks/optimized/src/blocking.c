@@ -0,0 +1,188 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#include "blocking.h"
+#include <string.h>
+#include <unistd.h>
+#include "plate.h"
+
+/// Fewest owned rows worth a full-width tile, narrower tiles are used below
+#define MIN_TILE_ROWS 8
+
+static size_t minOf(size_t first, size_t second) {
+  return first < second ? first : second;
+}
+
+size_t getCacheSize(int cacheName, size_t defaultSize) {
+  const long size = sysconf(cacheName);
+  return size > 0 ? (size_t)size : defaultSize;
+}
+
+TilePlan planTiles(size_t rows, size_t cols, size_t tileRows,
+  size_t tileCols) {
+  TilePlan plan;
+  const size_t interiorRows = rows > 2 ? rows - 2 : 0;
+  const size_t interiorCols = cols > 2 ? cols - 2 : 0;
+
+  if (interiorRows == 0 || interiorCols == 0) {
+    plan.tileRows = 0;
+    plan.tileCols = 0;
+    plan.tilesPerRow = 0;
+    plan.tilesCount = 0;
+    return plan;
+  }
+
+  plan.tileRows = tileRows == 0 ? interiorRows : minOf(tileRows, interiorRows);
+  plan.tileCols = tileCols == 0 ? interiorCols : minOf(tileCols, interiorCols);
+  plan.tilesPerRow = (interiorCols + plan.tileCols - 1) / plan.tileCols;
+  plan.tilesCount = plan.tilesPerRow
+    * ((interiorRows + plan.tileRows - 1) / plan.tileRows);
+  return plan;
+}
+
+TilePlan planCacheTiles(size_t rows, size_t cols) {
+  const size_t rowBudget = getCacheSize(_SC_LEVEL1_DCACHE_SIZE,
+    DEFAULT_ROW_CACHE_SIZE) / 2;
+  const size_t tileBudget = getCacheSize(_SC_LEVEL2_CACHE_SIZE,
+    DEFAULT_TILE_CACHE_SIZE * 2) / 2;
+
+  // 3 rows are read and 1 is written per stencil row, a cache line holds 8
+  size_t tileCols = rowBudget / (4 * sizeof(double)) / 8 * 8;
+  tileCols = tileCols < 8 ? 8 : tileCols;
+  // the tile of both plates, plus the rows above and below it
+  size_t tileRows = tileBudget / (2 * sizeof(double) * tileCols);
+  tileRows = tileRows > 2 ? tileRows - 2 : 1;
+  return planTiles(rows, cols, tileRows, tileCols);
+}
+
+TimeBlocking planTimeBlocking(size_t rows, size_t cols, size_t steps,
+  size_t cacheBytes) {
+  TimeBlocking blocking;
+  const size_t interiorCols = cols > 2 ? cols - 2 : 0;
+  const size_t halo = 2 * steps;
+  // cells of one scratch buffer, two of them must fit in the cache
+  const size_t budget = cacheBytes / (2 * sizeof(double));
+  size_t tileRows, tileCols;
+
+  blocking.steps = steps;
+  const size_t fullWidth = calcPlateStride(interiorCols + halo);
+  if (fullWidth * (MIN_TILE_ROWS + halo) <= budget) {
+    // whole rows fit, so tiles are bands that stream the plate linearly
+    tileCols = interiorCols;
+    tileRows = budget / fullWidth - halo;
+  } else {
+    // square tiles, as big as the budget allows
+    size_t side = MIN_TILE_ROWS;
+    while (calcPlateStride(side + MIN_TILE_ROWS + halo)
+      * (side + MIN_TILE_ROWS + halo) <= budget) {
+      side += MIN_TILE_ROWS;
+    }
+    tileCols = side;
+    tileRows = side;
+  }
+
+  blocking.tiles = planTiles(rows, cols, tileRows, tileCols);
+  blocking.scratchSize = blocking.tiles.tilesCount == 0 ? 0
+    : (blocking.tiles.tileRows + halo)
+      * calcPlateStride(blocking.tiles.tileCols + halo);
+  return blocking;
+}
+
+Tile getTile(const TilePlan* plan, size_t rows, size_t cols,
+  size_t tileIndex) {
+  Tile tile;
+  tile.startRow = 1 + tileIndex / plan->tilesPerRow * plan->tileRows;
+  tile.endRow = minOf(tile.startRow + plan->tileRows, rows - 1);
+  tile.startCol = 1 + tileIndex % plan->tilesPerRow * plan->tileCols;
+  tile.endCol = minOf(tile.startCol + plan->tileCols, cols - 1);
+  return tile;
+}
+
+int isTileActive(const TilePlan* plan, const unsigned char* changedTiles,
+  size_t tileIndex) {
+  const size_t col = tileIndex % plan->tilesPerRow;
+  // the 5-point stencil only reads the side neighbours
+  return changedTiles[tileIndex]
+    || (tileIndex >= plan->tilesPerRow
+      && changedTiles[tileIndex - plan->tilesPerRow])
+    || (tileIndex + plan->tilesPerRow < plan->tilesCount
+      && changedTiles[tileIndex + plan->tilesPerRow])
+    || (col > 0 && changedTiles[tileIndex - 1])
+    || (col + 1 < plan->tilesPerRow && changedTiles[tileIndex + 1]);
+}
+
+double updateTile(const Plate* readPlate, Plate* writePlate, Tile tile,
+  double factor, StencilRowFunction updateRow) {
+  const size_t stride = readPlate->stride;
+  double maxDelta = 0.0;
+  for (size_t row = tile.startRow; row < tile.endRow; ++row) {
+    double rowDelta = updateRow(PLATE_ROW(readPlate, row),
+      PLATE_ROW(writePlate, row), stride, tile.startCol, tile.endCol, factor);
+    maxDelta = rowDelta > maxDelta ? rowDelta : maxDelta;
+  }
+  return maxDelta;
+}
+
+void advanceTile(const Plate* readPlate, Plate* writePlate, Tile tile,
+  size_t steps, double factor, StencilRowFunction updateRow,
+  double* scratch[2], double* stepDeltas) {
+  const size_t rows = readPlate->rows;
+  const size_t cols = readPlate->cols;
+
+  // the tile and its halo, clipped to the plate
+  const size_t firstRow = tile.startRow > steps ? tile.startRow - steps : 0;
+  const size_t lastRow = minOf(tile.endRow + steps, rows);
+  const size_t firstCol = tile.startCol > steps ? tile.startCol - steps : 0;
+  const size_t lastCol = minOf(tile.endCol + steps, cols);
+  const size_t width = lastCol - firstCol;
+  const size_t stride = calcPlateStride(width);
+
+  // both buffers get the region, so the fixed borders are in both of them
+  for (size_t row = firstRow; row < lastRow; ++row) {
+    const double* source = PLATE_ROW(readPlate, row) + firstCol;
+    memcpy(scratch[0] + (row - firstRow) * stride, source,
+      width * sizeof(double));
+    memcpy(scratch[1] + (row - firstRow) * stride, source,
+      width * sizeof(double));
+  }
+
+  for (size_t step = 1; step <= steps; ++step) {
+    const double* current = scratch[(step - 1) % 2];
+    double* next = scratch[step % 2];
+    // cells that are still exact after this step, in local coordinates
+    const size_t shrink = steps - step;
+    const size_t stepFirstRow = tile.startRow > shrink
+      && tile.startRow - shrink > 1 ? tile.startRow - shrink : 1;
+    const size_t stepLastRow = minOf(tile.endRow + shrink, rows - 1);
+    const size_t stepFirstCol = (tile.startCol > shrink
+      && tile.startCol - shrink > 1 ? tile.startCol - shrink : 1) - firstCol;
+    const size_t stepLastCol = minOf(tile.endCol + shrink, cols - 1)
+      - firstCol;
+    const size_t ownedFirstCol = tile.startCol - firstCol;
+    const size_t ownedLastCol = tile.endCol - firstCol;
+
+    double maxDelta = stepDeltas[step - 1];
+    for (size_t row = stepFirstRow; row < stepLastRow; ++row) {
+      const size_t offset = (row - firstRow) * stride;
+      if (row >= tile.startRow && row < tile.endRow) {
+        // only the owned cells count for the convergence of this step
+        updateRow(current + offset, next + offset, stride, stepFirstCol,
+          ownedFirstCol, factor);
+        double delta = updateRow(current + offset, next + offset, stride,
+          ownedFirstCol, ownedLastCol, factor);
+        updateRow(current + offset, next + offset, stride, ownedLastCol,
+          stepLastCol, factor);
+        maxDelta = delta > maxDelta ? delta : maxDelta;
+      } else {
+        updateRow(current + offset, next + offset, stride, stepFirstCol,
+          stepLastCol, factor);
+      }
+    }
+    stepDeltas[step - 1] = maxDelta;
+  }
+
+  const double* last = scratch[steps % 2];
+  for (size_t row = tile.startRow; row < tile.endRow; ++row) {
+    memcpy(PLATE_ROW(writePlate, row) + tile.startCol,
+      last + (row - firstRow) * stride + tile.startCol - firstCol,
+      (tile.endCol - tile.startCol) * sizeof(double));
+  }
+}
@@ -0,0 +1,122 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#pragma once
+#include <stddef.h>
+#include "stencil.h"
+#include "types.h"
+
+/// Cache budget of a tile, in bytes, when the L2 size is unknown
+#define DEFAULT_TILE_CACHE_SIZE (512 * 1024)
+
+/// Cache budget of the rows of a tile, in bytes, when the L1 size is unknown
+#define DEFAULT_ROW_CACHE_SIZE (32 * 1024)
+
+/**
+ * @brief Queries the size of a CPU cache.
+ *
+ * @param cacheName A sysconf name, e.g. _SC_LEVEL2_CACHE_SIZE.
+ * @param defaultSize The size returned if the system does not report it.
+ * @return The size of the cache in bytes.
+ */
+size_t getCacheSize(int cacheName, size_t defaultSize);
+
+/**
+ * @brief Splits the interior of a plate into tiles of the given size.
+ *
+ * The size is clamped to the interior of the plate. A size of 0 uses the
+ * whole interior along that dimension.
+ *
+ * @param rows The number of rows of the plate.
+ * @param cols The number of columns of the plate.
+ * @param tileRows The number of rows of a tile.
+ * @param tileCols The number of columns of a tile.
+ * @return The tile plan.
+ */
+TilePlan planTiles(size_t rows, size_t cols, size_t tileRows,
+  size_t tileCols);
+
+/**
+ * @brief Splits the interior of a plate into tiles sized for the caches.
+ *
+ * A tile is narrow enough for the three rows read by the stencil and the
+ * written one to stay in L1, and short enough for the tile of both plates
+ * to stay in half of L2.
+ *
+ * @param rows The number of rows of the plate.
+ * @param cols The number of columns of the plate.
+ * @return The tile plan.
+ */
+TilePlan planCacheTiles(size_t rows, size_t cols);
+
+/**
+ * @brief Plans the tiles of a plate for temporal blocking.
+ *
+ * The tiles are as big as possible while both scratch buffers of a tile,
+ * halo included, fit in cacheBytes.
+ *
+ * @param rows The number of rows of the plate.
+ * @param cols The number of columns of the plate.
+ * @param steps The number of time steps advanced per pass.
+ * @param cacheBytes The cache size a tile should fit in.
+ * @return The tile plan.
+ */
+TimeBlocking planTimeBlocking(size_t rows, size_t cols, size_t steps,
+  size_t cacheBytes);
+
+/**
+ * @brief Gets the cells owned by a tile.
+ *
+ * @param plan The tile plan.
+ * @param rows The number of rows of the plate.
+ * @param cols The number of columns of the plate.
+ * @param tileIndex The index of the tile, less than tilesCount.
+ * @return The tile.
+ */
+Tile getTile(const TilePlan* plan, size_t rows, size_t cols,
+  size_t tileIndex);
+
+/**
+ * @brief Checks whether a tile may change on the next step.
+ *
+ * A tile whose cells and side neighbours did not change at all on the last
+ * step would compute exactly the same cells again, so it can be skipped.
+ *
+ * @param plan The tile plan.
+ * @param changedTiles Flag of every tile, nonzero if it changed last step.
+ * @param tileIndex The index of the tile.
+ * @return 1 if the tile must be updated, 0 if it is steady.
+ */
+int isTileActive(const TilePlan* plan, const unsigned char* changedTiles,
+  size_t tileIndex);
+
+/**
+ * @brief Advances the cells of a tile one time step.
+ *
+ * @param readPlate The plate with the current temperatures.
+ * @param writePlate The plate that receives the new temperatures.
+ * @param tile The tile to update.
+ * @param factor Constant part of the heat transfer formula.
+ * @param updateRow The stencil row kernel.
+ * @return The biggest absolute temperature change in the tile.
+ */
+double updateTile(const Plate* readPlate, Plate* writePlate, Tile tile,
+  double factor, StencilRowFunction updateRow);
+
+/**
+ * @brief Advances a tile several time steps in cache.
+ *
+ * Loads the tile and its halo from readPlate, advances it `steps` steps in
+ * the scratch buffers and stores the owned cells in writePlate. The biggest
+ * change of the owned cells on step s is max-accumulated in stepDeltas[s].
+ *
+ * @param readPlate The plate at the start of the pass.
+ * @param writePlate The plate that receives the state after `steps` steps.
+ * @param tile The tile to advance.
+ * @param steps The number of steps, at most the planned steps.
+ * @param factor Constant part of the heat transfer formula.
+ * @param updateRow The stencil row kernel.
+ * @param scratch Two buffers of scratchSize doubles, PLATE_ALIGNMENT aligned.
+ * @param stepDeltas Array of at least `steps` maximum changes.
+ */
+void advanceTile(const Plate* readPlate, Plate* writePlate, Tile tile,
+  size_t steps, double factor, StencilRowFunction updateRow,
+  double* scratch[2], double* stepDeltas);
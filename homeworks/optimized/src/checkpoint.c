@@ -0,0 +1,317 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#define _XOPEN_SOURCE 700
+#include "checkpoint.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "codec.h"
+#include "output.h"
+#include "plate.h"
+#include "solution.h"
+
+/// Marks a checkpoint file, "HEATCKP2" in little endian
+#define CHECKPOINT_MAGIC UINT64_C(0x32504b4354414548)
+
+/**
+ * @brief First bytes of a checkpoint file, the cells of a partial
+ * checkpoint follow without row padding.
+ */
+typedef struct {
+    uint64_t magic;  /// < CHECKPOINT_MAGIC
+    CheckpointKey key;  /// < the inputs of the job
+    uint64_t iterations;  /// < iterations done, or of the result if done
+    uint64_t isDone;  /// < indicates the job ended, no cells follow
+} CheckpointHeader;
+
+int isCheckpointing(const Arguments* args) {
+  return args->checkpointIterations > 0 || args->checkpointSeconds > 0
+    || args->shouldResume;
+}
+
+char* getCheckpointPath(const JobData* jobData) {
+  // the plate name fits, with ".ckpt" in place of its extension
+  const size_t pathSize = strlen(jobData->directory)
+    + strlen(jobData->plateFile) + sizeof("/.ckpt");
+  char* path = malloc(pathSize);
+  assert(path != NULL);
+  // the job keeps its file name, the extension is removed on the copy
+  const int directoryLength = snprintf(path, pathSize, "%s/",
+    jobData->directory);
+  char* plateName = path + directoryLength;
+  snprintf(plateName, pathSize - directoryLength, "%s", jobData->plateFile);
+  removeExtension(plateName);
+  strcat(plateName, ".ckpt");
+  return path;
+}
+
+// FNV-1a, enough to tell two job files apart
+static uint64_t hashString(const char* text) {
+  uint64_t hash = UINT64_C(0xcbf29ce484222325);
+  for (; *text != '\0'; ++text) {
+    hash = (hash ^ (unsigned char) *text) * UINT64_C(0x100000001b3);
+  }
+  return hash;
+}
+
+// Fills the key of a job from its parameters and its files, returns 0 if
+// the plate file cannot be read
+static int readCheckpointKey(const JobData* jobData, const char* jobFile,
+  CheckpointKey* key) {
+  memset(key, 0, sizeof(*key));
+  char* fullPath = realpath(jobFile, NULL);
+  key->jobFile = hashString(fullPath != NULL ? fullPath : jobFile);
+  free(fullPath);
+  key->jobIndex = jobData->jobIndex;
+  key->duration = jobData->duration;
+  key->thermalDiffusivity = jobData->thermalDiffusivity;
+  key->plateCellDimmensions = jobData->plateCellDimmensions;
+  key->balancePoint = jobData->balancePoint;
+
+  const size_t pathSize = strlen(jobData->directory)
+    + strlen(jobData->plateFile) + 2;
+  char* path = malloc(pathSize);
+  assert(path != NULL);
+  snprintf(path, pathSize, "%s/%s", jobData->directory, jobData->plateFile);
+  FILE* file = fopen(path, "rb");
+  free(path);
+  struct stat fileInfo;
+  // a compressed plate has its size after the magic number
+  uint64_t size[3] = {0, 0, 0};
+  const int isRead = file != NULL && fstat(fileno(file), &fileInfo) == 0
+    && fread(size, sizeof(uint64_t), 3, file) >= 2;
+  if (file != NULL) {
+    fclose(file);
+  }
+  if (!isRead) {
+    return 0;
+  }
+  const int isCompressed = isCompressedPlate(size, sizeof(size));
+  key->rows = size[isCompressed];
+  key->cols = size[isCompressed + 1];
+  key->plateSize = fileInfo.st_size;
+  key->plateSeconds = fileInfo.st_mtim.tv_sec;
+  key->plateNanoseconds = fileInfo.st_mtim.tv_nsec;
+  return 1;
+}
+
+// Writes the file next to the checkpoint and renames it over the old one
+static void writeCheckpoint(const char* path, const CheckpointHeader* header,
+  const Plate* plate) {
+  const size_t temporaryPathSize = strlen(path) + sizeof(".tmp");
+  char* temporaryPath = malloc(temporaryPathSize);
+  assert(temporaryPath != NULL);
+  snprintf(temporaryPath, temporaryPathSize, "%s.tmp", path);
+  FILE* file = fopen(temporaryPath, "wb");
+  if (file == NULL) {
+    fprintf(stderr, "Warning: could not write checkpoint %s\n", path);
+    free(temporaryPath);
+    return;
+  }
+
+  int isWritten = fwrite(header, sizeof(CheckpointHeader), 1, file) == 1;
+  for (size_t row = 0; plate != NULL && row < plate->rows && isWritten;
+    ++row) {
+    isWritten = fwrite(PLATE_ROW(plate, row), sizeof(double), plate->cols,
+      file) == plate->cols;
+  }
+  isWritten = fflush(file) == 0 && isWritten;
+  isWritten = fsync(fileno(file)) == 0 && isWritten;
+  isWritten = fclose(file) == 0 && isWritten;
+  if (!isWritten || rename(temporaryPath, path) != 0) {
+    fprintf(stderr, "Warning: could not write checkpoint %s\n", path);
+    remove(temporaryPath);
+  }
+  free(temporaryPath);
+}
+
+static void* writeSnapshots(void* data) {
+  Checkpointer* checkpointer = (Checkpointer*) data;
+  pthread_mutex_lock(&checkpointer->mutex);
+  while (1) {
+    while (checkpointer->filledSnapshot < 0 && !checkpointer->isStopping) {
+      pthread_cond_wait(&checkpointer->snapshotReady, &checkpointer->mutex);
+    }
+    if (checkpointer->isStopping) {
+      break;
+    }
+    const int snapshot = checkpointer->filledSnapshot;
+    checkpointer->filledSnapshot = -1;
+    checkpointer->writingSnapshot = snapshot;
+    pthread_mutex_unlock(&checkpointer->mutex);
+
+    const Plate* plate = checkpointer->snapshots[snapshot];
+    CheckpointHeader header = {CHECKPOINT_MAGIC, checkpointer->key,
+      checkpointer->snapshotIterations[snapshot], 0};
+    writeCheckpoint(checkpointer->path, &header, plate);
+
+    pthread_mutex_lock(&checkpointer->mutex);
+    checkpointer->writingSnapshot = -1;
+  }
+  pthread_mutex_unlock(&checkpointer->mutex);
+  return NULL;
+}
+
+void startCheckpointer(Checkpointer* checkpointer, const JobData* jobData,
+  const Plate* plate, size_t firstIteration, const Arguments* args) {
+  checkpointer->path = getCheckpointPath(jobData);
+  // without its plate file the key matches no job, the snapshots are only
+  // lost for --resume
+  readCheckpointKey(jobData, args->jobFile, &checkpointer->key);
+  checkpointer->everyIterations = args->checkpointIterations;
+  checkpointer->everySeconds = args->checkpointSeconds;
+  checkpointer->nextIteration = firstIteration + args->checkpointIterations;
+  clock_gettime(CLOCK_MONOTONIC, &checkpointer->lastTime);
+  for (size_t snapshot = 0; snapshot < 2; ++snapshot) {
+    checkpointer->snapshots[snapshot] = createPlateStrided(plate->rows,
+      plate->cols, plate->stride);
+    checkpointer->snapshotIterations[snapshot] = 0;
+  }
+  checkpointer->filledSnapshot = -1;
+  checkpointer->writingSnapshot = -1;
+  checkpointer->copyingSnapshot = -1;
+  checkpointer->copySource = NULL;
+  checkpointer->isStopping = 0;
+  pthread_mutex_init(&checkpointer->mutex, NULL);
+  pthread_cond_init(&checkpointer->snapshotReady, NULL);
+  if (pthread_create(&checkpointer->writer, NULL, writeSnapshots,
+    checkpointer) != EXIT_SUCCESS) {
+    fprintf(stderr, "Error: could not create checkpoint thread\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void offerCheckpoint(Checkpointer* checkpointer, const Plate* plate,
+  size_t iterations) {
+  // the team finished copying the previous snapshot in the last iteration
+  if (checkpointer->copyingSnapshot >= 0) {
+    pthread_mutex_lock(&checkpointer->mutex);
+    checkpointer->filledSnapshot = checkpointer->copyingSnapshot;
+    pthread_cond_signal(&checkpointer->snapshotReady);
+    pthread_mutex_unlock(&checkpointer->mutex);
+    checkpointer->copyingSnapshot = -1;
+  }
+
+  int isDue = checkpointer->everyIterations > 0
+    && iterations >= checkpointer->nextIteration;
+  struct timespec now;
+  if (!isDue && checkpointer->everySeconds > 0) {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    isDue = (now.tv_sec - checkpointer->lastTime.tv_sec) + (now.tv_nsec
+      - checkpointer->lastTime.tv_nsec) / 1e9 >= checkpointer->everySeconds;
+  }
+  if (!isDue) {
+    return;
+  }
+
+  // fill a buffer the writer is neither writing nor about to take, or else
+  // replace the older snapshot it did not take yet
+  pthread_mutex_lock(&checkpointer->mutex);
+  const int snapshot = checkpointer->writingSnapshot == 0
+    || (checkpointer->writingSnapshot < 0
+    && checkpointer->filledSnapshot == 0) ? 1 : 0;
+  if (checkpointer->filledSnapshot == snapshot) {
+    checkpointer->filledSnapshot = -1;
+  }
+  pthread_mutex_unlock(&checkpointer->mutex);
+
+  // the team copies it during the next iteration, which only reads the plate
+  checkpointer->snapshotIterations[snapshot] = iterations;
+  checkpointer->copySource = plate;
+  checkpointer->copyingSnapshot = snapshot;
+
+  checkpointer->nextIteration = iterations + checkpointer->everyIterations;
+  clock_gettime(CLOCK_MONOTONIC, &checkpointer->lastTime);
+}
+
+void copyCheckpointRows(const Checkpointer* checkpointer,
+  size_t threadNumber, size_t threadCount) {
+  if (checkpointer == NULL || checkpointer->copyingSnapshot < 0) {
+    return;
+  }
+  const Plate* plate = checkpointer->copySource;
+  const size_t firstRow = threadNumber * plate->rows / threadCount;
+  const size_t endRow = (threadNumber + 1) * plate->rows / threadCount;
+  memcpy(PLATE_ROW(checkpointer->snapshots[checkpointer->copyingSnapshot],
+    firstRow), PLATE_ROW(plate, firstRow), (endRow - firstRow)
+    * plate->stride * sizeof(double));
+}
+
+void stopCheckpointer(Checkpointer* checkpointer) {
+  pthread_mutex_lock(&checkpointer->mutex);
+  checkpointer->isStopping = 1;
+  pthread_cond_signal(&checkpointer->snapshotReady);
+  pthread_mutex_unlock(&checkpointer->mutex);
+  pthread_join(checkpointer->writer, NULL);
+
+  pthread_cond_destroy(&checkpointer->snapshotReady);
+  pthread_mutex_destroy(&checkpointer->mutex);
+  destroyPlate(checkpointer->snapshots[0]);
+  destroyPlate(checkpointer->snapshots[1]);
+  free(checkpointer->path);
+}
+
+void markCheckpointDone(const JobData* jobData, const char* jobFile,
+  size_t iterations) {
+  char* path = getCheckpointPath(jobData);
+  CheckpointHeader header = {CHECKPOINT_MAGIC, {0}, iterations, 1};
+  if (readCheckpointKey(jobData, jobFile, &header.key)) {
+    writeCheckpoint(path, &header, NULL);
+  } else {
+    remove(path);
+  }
+  free(path);
+}
+
+void removeCheckpoint(const JobData* jobData) {
+  char* path = getCheckpointPath(jobData);
+  remove(path);
+  free(path);
+}
+
+CheckpointStatus loadCheckpoint(const JobData* jobData, const char* jobFile,
+  Plate** plate, size_t* iterations) {
+  char* path = getCheckpointPath(jobData);
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    free(path);
+    return CHECKPOINT_NONE;
+  }
+
+  // every field of the key is 8 bytes wide, there is no padding to compare
+  CheckpointHeader header;
+  CheckpointKey key;
+  CheckpointStatus status = CHECKPOINT_NONE;
+  if (fread(&header, sizeof(header), 1, file) == 1
+    && header.magic == CHECKPOINT_MAGIC
+    && readCheckpointKey(jobData, jobFile, &key)
+    && memcmp(&header.key, &key, sizeof(key)) == 0) {
+    *iterations = header.iterations;
+    status = header.isDone ? CHECKPOINT_DONE : CHECKPOINT_PARTIAL;
+  }
+
+  if (status == CHECKPOINT_PARTIAL) {
+    const size_t rows = header.key.rows;
+    const size_t cols = header.key.cols;
+    *plate = createPlate(rows, cols);
+    for (size_t row = 0; row < rows; ++row) {
+      if (fread(PLATE_ROW(*plate, row), sizeof(double), cols, file)
+        != cols) {
+        destroyPlate(*plate);
+        *plate = NULL;
+        status = CHECKPOINT_NONE;
+        break;
+      }
+    }
+  }
+  fclose(file);
+
+  if (status == CHECKPOINT_NONE) {
+    fprintf(stderr, "Warning: ignoring checkpoint %s\n", path);
+  }
+  free(path);
+  return status;
+}
@@ -0,0 +1,170 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#pragma once
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "types.h"
+
+/**
+ * @brief What a job left in its checkpoint file.
+ */
+typedef enum {
+  CHECKPOINT_NONE,  /// < no usable checkpoint, the job starts over
+  CHECKPOINT_PARTIAL,  /// < the plate of an unfinished simulation
+  CHECKPOINT_DONE  /// < the job ended and its result was written
+} CheckpointStatus;
+
+/**
+ * @brief The inputs a checkpoint was computed from. A checkpoint is only
+ * resumed if the job still has the same ones.
+ */
+typedef struct {
+    uint64_t jobFile;  /// < hash of the full path of the job file
+    uint64_t jobIndex;  /// < position of the job in the job file
+    double duration;  /// < duration of each iteration
+    double thermalDiffusivity;  /// < thermal diffusivity of the plate
+    double plateCellDimmensions;  /// < dimensions of the plate cells
+    double balancePoint;  /// < balance point of the plate
+    uint64_t rows;  /// < rows of the initial plate
+    uint64_t cols;  /// < columns of the initial plate
+    uint64_t plateSize;  /// < bytes of the plate file
+    int64_t plateSeconds;  /// < modification time of the plate file
+    int64_t plateNanoseconds;  /// < nanoseconds of the modification time
+} CheckpointKey;
+
+/**
+ * @struct Checkpointer
+ * @brief Saves snapshots of a running simulation in the background.
+ *
+ * Snapshots are double buffered: the barrier action picks the buffer the
+ * writer thread is not writing, and every thread of the team copies its
+ * band of rows of the read plate into it at the start of the next
+ * iteration, which does not change that plate. The next barrier action
+ * hands the snapshot to the writer, so the simulation never waits for the
+ * disk, nor for a whole-plate copy. A snapshot not taken by the writer yet
+ * is replaced by a newer one. The file is replaced atomically, so a
+ * crash while writing keeps the previous checkpoint.
+ */
+typedef struct Checkpointer {
+    char* path;  /// < the checkpoint file
+    CheckpointKey key;  /// < inputs of the job the checkpoint belongs to
+    size_t everyIterations;  /// < iterations between snapshots, 0 if unused
+    double everySeconds;  /// < seconds between snapshots, 0 if unused
+    size_t nextIteration;  /// < iteration of the next snapshot
+    struct timespec lastTime;  /// < time of the last snapshot
+    Plate* snapshots[2];  /// < the double buffer
+    size_t snapshotIterations[2];  /// < iterations of every snapshot
+    int filledSnapshot;  /// < snapshot waiting for the writer, -1 if none
+    int copyingSnapshot;  /// < snapshot the team fills, -1 if none
+    const Plate* copySource;  /// < plate the team copies into it
+    int writingSnapshot;  /// < snapshot being written, -1 if none
+    short isStopping;  /// < indicates the writer must exit
+    pthread_t writer;  /// < thread that writes the snapshots
+    pthread_mutex_t mutex;  /// < protects the snapshot indexes
+    pthread_cond_t snapshotReady;  /// < signaled when a snapshot is filled
+} Checkpointer;
+
+/**
+ * @brief Tells whether the arguments ask for checkpoint files.
+ *
+ * @param args The arguments.
+ * @return 1 if jobs must be checkpointed or resumed, 0 otherwise.
+ */
+int isCheckpointing(const Arguments* args);
+
+/**
+ * @brief Builds the path of the checkpoint file of a job.
+ *
+ * The file is <plate>.ckpt, next to the plate of the job.
+ *
+ * @param jobData The job.
+ * @return The path, freed by the caller.
+ */
+char* getCheckpointPath(const JobData* jobData);
+
+/**
+ * @brief Starts the writer thread of a job.
+ *
+ * @param checkpointer The checkpointer to initialize.
+ * @param jobData The job.
+ * @param plate Any plate of the job, gives the size of the snapshots.
+ * @param firstIteration The iterations done when the simulation starts.
+ * @param args The arguments, give the period of the snapshots.
+ */
+void startCheckpointer(Checkpointer* checkpointer, const JobData* jobData,
+  const Plate* plate, size_t firstIteration, const Arguments* args);
+
+/**
+ * @brief Takes a snapshot if the period elapsed.
+ *
+ * Meant for the barrier action, between two iterations. Hands the snapshot
+ * the team copied in the last iteration to the writer thread, and if the
+ * period elapsed, picks the buffer the team copies the plate into during
+ * the next one, see copyCheckpointRows. The plate must not change until
+ * the next call.
+ *
+ * @param checkpointer The checkpointer.
+ * @param plate The state after the given iterations.
+ * @param iterations The iterations done.
+ */
+void offerCheckpoint(Checkpointer* checkpointer, const Plate* plate,
+  size_t iterations);
+
+/**
+ * @brief Copies a band of rows of the plate offered to a checkpointer.
+ *
+ * Every thread of the team calls it at the start of every iteration, it
+ * does nothing unless a snapshot is due.
+ *
+ * @param checkpointer The checkpointer, or NULL if the job has none.
+ * @param threadNumber The thread, gives its band of rows.
+ * @param threadCount The threads of the team.
+ */
+void copyCheckpointRows(const Checkpointer* checkpointer,
+  size_t threadNumber, size_t threadCount);
+
+/**
+ * @brief Stops the writer thread and frees the snapshots.
+ *
+ * A snapshot that was not taken by the writer yet is dropped.
+ *
+ * @param checkpointer The checkpointer.
+ */
+void stopCheckpointer(Checkpointer* checkpointer);
+
+/**
+ * @brief Records that a job ended and its result was written.
+ *
+ * Replaces the snapshot of the job, a resumed run skips the job.
+ *
+ * @param jobData The job.
+ * @param jobFile The job file the job was read from.
+ * @param iterations The iterations of the result.
+ */
+void markCheckpointDone(const JobData* jobData, const char* jobFile,
+  size_t iterations);
+
+/**
+ * @brief Removes the checkpoint file of a job, if any.
+ *
+ * @param jobData The job.
+ */
+void removeCheckpoint(const JobData* jobData);
+
+/**
+ * @brief Reads the checkpoint of a job, if any.
+ *
+ * A truncated file is ignored, and so is the file of a job with other
+ * inputs: another job file or position in it, other parameters, or a plate
+ * file of another size or modification time.
+ *
+ * @param jobData The job.
+ * @param jobFile The job file the job was read from.
+ * @param plate Receives the saved plate when the status is partial.
+ * @param iterations Receives the iterations done by the saved plate, or the
+ * iterations of the result when the status is done.
+ * @return What the checkpoint holds.
+ */
+CheckpointStatus loadCheckpoint(const JobData* jobData, const char* jobFile,
+  Plate** plate, size_t* iterations);
@@ -0,0 +1,54 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "types.h"
+
+/// First 8 bytes of a compressed plate file, "HEATZBIN" in little endian.
+/// As a row count it would need an exabyte file, so raw plates never match
+#define PLATE_CODEC_MAGIC UINT64_C(0x4e49425a54414548)
+
+/// Cells per compressed block, blocks are coded by different threads
+#define CODEC_BLOCK_CELLS (64 * 1024)
+
+/// Longest Huffman code, the decoder uses a table of 2^this entries
+#define CODEC_MAX_CODE_LENGTH 12
+
+/**
+ * @brief Tells whether a plate file is compressed.
+ *
+ * @param file The contents of the file.
+ * @param fileSize The size of the file in bytes.
+ * @return 1 if the file starts with PLATE_CODEC_MAGIC, 0 otherwise.
+ */
+int isCompressedPlate(const void* file, size_t fileSize);
+
+/**
+ * @brief Writes a plate in the compressed format.
+ *
+ * The plate is split in blocks of whole rows. Every cell is predicted from
+ * its neighbors above and on the left in the same block, and the zigzag
+ * coded difference of the bits is stored, so smooth plates leave mostly
+ * zero high bytes. The 8 bytes of the residuals are split in 8 planes, and
+ * every plane is stored as a constant, raw, or Huffman coded, whichever is
+ * smaller. Lossless. A plate that would not get smaller, e.g. a tiny one,
+ * is written in the raw format instead.
+ *
+ * @param plate The plate.
+ * @param file The open file, written from its current position.
+ * @param threadCount The threads that compress the blocks.
+ * @return 1 on success, 0 if the file could not be written.
+ */
+int writeCompressedPlate(const Plate* plate, FILE* file, size_t threadCount);
+
+/**
+ * @brief Decodes a compressed plate file.
+ *
+ * @param file The contents of the file.
+ * @param fileSize The size of the file in bytes.
+ * @param threadCount The threads that decompress the blocks.
+ * @return The plate, or NULL if the file is corrupt.
+ */
+Plate* readCompressedPlate(const void* file, size_t fileSize,
+  size_t threadCount);
@@ -1,12 +1,42 @@
 // Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#define _DEFAULT_SOURCE
 #include "input.h"
 #include <assert.h>
+#include <ctype.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#include "codec.h"
+#include "jobs.h"
+#include "plate.h"
+#include "solution.h"
 #include "types.h"
 
-#define MAX_PATH_SIZE 100
+/// Longest number of a job file, with its terminator
+#define MAX_NUMBER_SIZE 64
+
+// Reads N (iterations) or Ns (seconds) into the checkpoint period
+static void parseCheckpointPeriod(const char* period, Arguments* args) {
+  char unit = '\0';
+  double seconds = 0;
+  size_t iterations = 0;
+  if (sscanf(period, "%lf%c", &seconds, &unit) == 2 && unit == 's'
+    && seconds > 0) {
+    args->checkpointSeconds = seconds;
+    args->checkpointIterations = 0;
+  } else if (sscanf(period, "%zu%c", &iterations, &unit) == 1
+    && iterations > 0) {
+    args->checkpointIterations = iterations;
+    args->checkpointSeconds = 0;
+  } else {
+    fprintf(stderr, "Error: invalid checkpoint period %s\n", period);
+    exit(EXIT_FAILURE);
+  }
+}
 
 Arguments processArguments(int argc, char **argv) {
   const int MIN_ARGUMENTS_COUNT = 3;  // 3 arguments are expected
@@ -14,6 +44,19 @@ Arguments processArguments(int argc, char **argv) {
   Arguments args;
   args.isVerbose = 0;
   args.shloudPrintIterations = 0;
+  args.prefetchCount = DEFAULT_PREFETCH_COUNT;
+  args.stencilKernel = findStencilKernel(NULL);
+  args.timeBlockSteps = 1;
+  args.tileRows = 0;
+  args.tileCols = 0;
+  args.schedulePolicy = SCHEDULE_GUIDED;
+  args.shouldPinThreads = 0;
+  args.shouldSkipSteadyTiles = 0;
+  args.isMixedPrecision = 0;
+  args.checkpointIterations = 0;
+  args.checkpointSeconds = 0;
+  args.shouldResume = 0;
+  args.shouldCompress = 0;
 
   if (argc == 2 && (strcmp(argv[1], "-h") == 0 ||
     strcmp(argv[1], "--help") == 0)) {
@@ -25,11 +68,38 @@ Arguments processArguments(int argc, char **argv) {
       fprintf(stderr, "-v, --verbose: show verbose output\n");
       fprintf(stderr,
         "-i, --iterations: show current iteration (k) number\n");
+      fprintf(stderr, "--prefetch=N: plates read ahead of the running "
+        "jobs, by default %d\n", DEFAULT_PREFETCH_COUNT);
+      fprintf(stderr, "--kernel=NAME: force the stencil kernel "
+        "(avx512, avx2, sse2 or scalar), by default the best one\n");
+      fprintf(stderr, "--time-block=T: advance each cache-sized tile T "
+        "time steps per pass (temporal blocking), by default 1\n");
+      fprintf(stderr, "--tile=RxC: rows and columns of the tiles of the "
+        "block mapping, by default sized for the caches\n");
+      fprintf(stderr, "--schedule=POLICY: how the dynamic mapping hands out "
+        "blocks, guided (default) or steal\n");
+      fprintf(stderr, "--pin: pin each worker thread to its own CPU\n");
+      fprintf(stderr, "--active-tiles: skip the tiles that did not change, "
+        "nor their neighbours, on the previous step\n");
+      fprintf(stderr, "--precision=double|mixed: mixed runs the first "
+        "steps in float and switches to double once the biggest change is "
+        "below %d times epsilon; cells may differ from double by up to "
+        "2e-6 times the hottest cell, and k only when a late step changes "
+        "the plate by almost exactly epsilon\n", MIXED_SWITCH_FACTOR);
+      fprintf(stderr, "--checkpoint-every=N|Ns: save the plate of every "
+        "job to <plate>.ckpt every N iterations or N seconds\n");
+      fprintf(stderr, "--resume: continue the jobs from their checkpoints "
+        "and skip the ones that ended; a checkpoint of a job whose "
+        "parameters, plate or job file changed is ignored, and the "
+        "checkpoints are removed once a run writes all its results\n");
+      fprintf(stderr, "--compress: write the result plates in the lossless "
+        "compressed format, plates are read in either format\n");
 
   } else if ( argc >= MIN_ARGUMENTS_COUNT ) {
      // assign the arguments to the struct
     args.jobFile = argv[1];
-    if (sscanf(argv[2], "%zu", &args.threadsCount) != 1) {
+    if (sscanf(argv[2], "%zu", &args.threadsCount) != 1
+      || args.threadsCount == 0) {
       args.threadsCount = sysconf(_SC_NPROCESSORS_ONLN);
     }
 
@@ -40,10 +110,70 @@ Arguments processArguments(int argc, char **argv) {
         } else if (strcmp(argv[i], "-i") == 0 || strcmp(argv[i],
           "--iterations") == 0) {
           args.shloudPrintIterations = 1;
+        } else if (strncmp(argv[i], "--prefetch=", 11) == 0) {
+          if (sscanf(argv[i] + 11, "%zu", &args.prefetchCount) != 1
+            || args.prefetchCount == 0) {
+            fprintf(stderr, "Error: invalid prefetch %s\n", argv[i] + 11);
+            exit(EXIT_FAILURE);
+          }
+        } else if (strncmp(argv[i], "--kernel=", 9) == 0) {
+          args.stencilKernel = findStencilKernel(argv[i] + 9);
+          if (args.stencilKernel.updateRow == NULL) {
+            fprintf(stderr, "Error: kernel %s is not supported\n",
+              args.stencilKernel.name);
+            exit(EXIT_FAILURE);
+          }
+        } else if (strncmp(argv[i], "--time-block=", 13) == 0) {
+          if (sscanf(argv[i] + 13, "%zu", &args.timeBlockSteps) != 1
+            || args.timeBlockSteps == 0) {
+            fprintf(stderr, "Error: invalid time block %s\n", argv[i] + 13);
+            exit(EXIT_FAILURE);
+          }
+        } else if (strncmp(argv[i], "--tile=", 7) == 0) {
+          if (sscanf(argv[i] + 7, "%zux%zu", &args.tileRows, &args.tileCols)
+            != 2 || args.tileRows == 0 || args.tileCols == 0) {
+            fprintf(stderr, "Error: invalid tile %s\n", argv[i] + 7);
+            exit(EXIT_FAILURE);
+          }
+        } else if (strcmp(argv[i], "--pin") == 0) {
+          args.shouldPinThreads = 1;
+        } else if (strcmp(argv[i], "--active-tiles") == 0) {
+          args.shouldSkipSteadyTiles = 1;
+        } else if (strcmp(argv[i], "--precision=mixed") == 0) {
+          args.isMixedPrecision = 1;
+        } else if (strcmp(argv[i], "--precision=double") == 0) {
+          args.isMixedPrecision = 0;
+        } else if (strncmp(argv[i], "--checkpoint-every=", 19) == 0) {
+          parseCheckpointPeriod(argv[i] + 19, &args);
+        } else if (strcmp(argv[i], "--resume") == 0) {
+          args.shouldResume = 1;
+        } else if (strcmp(argv[i], "--compress") == 0) {
+          args.shouldCompress = 1;
+        } else if (strncmp(argv[i], "--schedule=", 11) == 0) {
+          if (!findSchedulePolicy(argv[i] + 11, &args.schedulePolicy)) {
+            fprintf(stderr, "Error: unknown schedule %s\n", argv[i] + 11);
+            exit(EXIT_FAILURE);
+          }
         }
       }
       printf("Verbose: %d\n", args.isVerbose);
       printf("Print iterations: %d\n", args.shloudPrintIterations);
+      if (args.isVerbose) {
+        printf("Stencil kernel: %s\n", args.stencilKernel.name);
+        printf("Time block steps: %zu\n", args.timeBlockSteps);
+        if (args.tileRows != 0) {
+          printf("Tile: %zux%zu\n", args.tileRows, args.tileCols);
+        }
+        printf("Schedule: %s\n", args.schedulePolicy == SCHEDULE_STEAL
+          ? "steal" : "guided");
+        printf("Pin threads: %d\n", args.shouldPinThreads);
+        printf("Active tiles: %d\n", args.shouldSkipSteadyTiles);
+        printf("Precision: %s\n", args.isMixedPrecision ? "mixed" : "double");
+        printf("Checkpoint every: %zu iterations, %.0f s\n",
+          args.checkpointIterations, args.checkpointSeconds);
+        printf("Resume: %d\n", args.shouldResume);
+        printf("Compress: %d\n", args.shouldCompress);
+      }
     }
   } else {
     fprintf(stderr, "Usage: %s <jobFile> <threadsCount>\n", argv[0]);
@@ -54,86 +184,211 @@ Arguments processArguments(int argc, char **argv) {
   return args;
 }
 
-JobData *readJobData(const char *jobFile) {
-  FILE *file = fopen(jobFile, "r");
-  if (file == NULL) {
-    fprintf(stderr, "Error opening file: %s\n", jobFile);
-    exit(EXIT_FAILURE);
-  }
+/**
+ * @brief Position of the parser in a job file.
+ */
+typedef struct {
+    const char* next;  /// < next character to parse
+    const char* end;  /// < end of the file contents
+    const char* jobFile;  /// < path of the job file, for the errors
+    size_t line;  /// < line of next, counted from 1
+} JobFileCursor;
 
-  // get the directory from the job file
-  char directory[MAX_PATH_SIZE];
-  getDirectory(jobFile, directory, MAX_PATH_SIZE);
+static void failJobFile(const JobFileCursor* cursor, const char* message,
+  const char* token, size_t tokenLength) {
+  fprintf(stderr, "Error: %s:%zu: %s '%.*s'\n", cursor->jobFile,
+    cursor->line, message, (int) tokenLength, token);
+  exit(EXIT_FAILURE);
+}
 
-  // Read the number of jobs based on the number of lines in the file
-  size_t jobs = calcFileLinesCount(jobFile);
-  JobData *jobData = malloc(jobs * sizeof(JobData));
+// Skips the spaces of the line, not its end
+static void skipBlanks(JobFileCursor* cursor) {
+  while (cursor->next < cursor->end && *cursor->next != '\n'
+    && isspace((unsigned char) *cursor->next)) {
+    ++cursor->next;
+  }
+}
 
-  assert(jobData != NULL);  // Check if memory allocation was successful
+// Moves past the next word of the line and returns its length
+static size_t takeToken(JobFileCursor* cursor, const char** token) {
+  skipBlanks(cursor);
+  *token = cursor->next;
+  while (cursor->next < cursor->end
+    && !isspace((unsigned char) *cursor->next)) {
+    ++cursor->next;
+  }
+  return cursor->next - *token;
+}
 
-  // Read the job data from the file and store it in the array
-  for (size_t i = 0; i < jobs; i++) {
-    jobData[i].plateFile = malloc(MAX_PATH_SIZE * sizeof(char));
-    jobData[i].directory = malloc(MAX_PATH_SIZE * sizeof(char));
-    fscanf(file, "%s", jobData[i].plateFile);
-    fscanf(file, "%lf", &jobData[i].duration);
-    fscanf(file, "%lf", &jobData[i].thermalDiffusivity);
-    fscanf(file, "%lf", &jobData[i].plateCellDimmensions);
-    fscanf(file, "%lf", &jobData[i].balancePoint);
-    snprintf(jobData[i].directory, MAX_PATH_SIZE,
-      "%s", directory);
-  }
-  fclose(file);
-  return jobData;
+static double parseJobNumber(JobFileCursor* cursor, const char* field) {
+  const char* token = NULL;
+  const size_t length = takeToken(cursor, &token);
+  if (length == 0) {
+    failJobFile(cursor, field, "", 0);
+  }
+  // the file is not null terminated, strtod reads a copy of the word
+  char number[MAX_NUMBER_SIZE];
+  char* numberEnd = number;
+  double value = 0;
+  if (length < MAX_NUMBER_SIZE) {
+    memcpy(number, token, length);
+    number[length] = '\0';
+    value = strtod(number, &numberEnd);
+  }
+  if (numberEnd != number + length) {
+    failJobFile(cursor, field, token, length);
+  }
+  return value;
 }
 
-size_t calcFileLinesCount(const char *filePath) {
-  FILE *file = fopen(filePath, "r");
-  if (file == NULL) {
-    fprintf(stderr, "Error opening file: %s\n", filePath);
+JobData *readJobData(const char *jobFile, size_t* jobsCount) {
+  int file = open(jobFile, O_RDONLY);
+  struct stat fileInfo;
+  if (file < 0 || fstat(file, &fileInfo) != 0) {
+    fprintf(stderr, "Error opening file: %s\n", jobFile);
     exit(EXIT_FAILURE);
   }
-  size_t linesCount = 0;
-  char c;
-  // Count the number of lines in the file
-  while ((c = fgetc(file)) != EOF) {
-    if (c == '\n') {
-      linesCount++;
+  const size_t fileSize = fileInfo.st_size;
+  const char* contents = fileSize > 0 ? mmap(NULL, fileSize, PROT_READ,
+    MAP_PRIVATE, file, 0) : NULL;
+  close(file);
+  if (contents == MAP_FAILED) {
+    fprintf(stderr, "Error reading file: %s\n", jobFile);
+    exit(EXIT_FAILURE);
+  }
+
+  // the strings go to an arena: the directory, and every plate name with
+  // its terminator, which fit in the size of the file plus one byte
+  const size_t directorySize = strlen(jobFile) + 1;
+  char* strings = malloc(directorySize + fileSize + 1);
+  assert(strings != NULL);
+  getDirectory(jobFile, strings, directorySize);
+  size_t stringsSize = strlen(strings) + 1;
+
+  size_t capacity = 64;
+  size_t jobs = 0;
+  JobData* jobData = malloc(capacity * sizeof(JobData));
+  assert(jobData != NULL);
+
+  JobFileCursor cursor = {contents, contents + fileSize, jobFile, 1};
+  while (cursor.next < cursor.end) {
+    const char* plateFile = NULL;
+    const size_t plateFileLength = takeToken(&cursor, &plateFile);
+    if (plateFileLength > 0) {
+      if (jobs == capacity) {
+        capacity *= 2;
+        jobData = realloc(jobData, capacity * sizeof(JobData));
+        assert(jobData != NULL);
+      }
+      jobData[jobs].plateFile = strings + stringsSize;
+      memcpy(strings + stringsSize, plateFile, plateFileLength);
+      stringsSize += plateFileLength;
+      strings[stringsSize++] = '\0';
+      jobData[jobs].duration = parseJobNumber(&cursor,
+        "expected the duration, found");
+      jobData[jobs].thermalDiffusivity = parseJobNumber(&cursor,
+        "expected the thermal diffusivity, found");
+      jobData[jobs].plateCellDimmensions = parseJobNumber(&cursor,
+        "expected the cell dimensions, found");
+      jobData[jobs].balancePoint = parseJobNumber(&cursor,
+        "expected the balance point, found");
+      jobData[jobs].jobIndex = jobs;
+      ++jobs;
+
+      const char* extra = NULL;
+      const size_t extraLength = takeToken(&cursor, &extra);
+      if (extraLength > 0) {
+        failJobFile(&cursor, "unexpected text after the job", extra,
+          extraLength);
+      }
+    }
+    // blank lines are skipped
+    if (cursor.next < cursor.end) {
+      ++cursor.next;
+      ++cursor.line;
     }
   }
-  fclose(file);
-  return linesCount;
+  if (contents != NULL) {
+    munmap((void*) contents, fileSize);
+  }
+  if (jobs == 0) {
+    fprintf(stderr, "Error: %s has no jobs\n", jobFile);
+    exit(EXIT_FAILURE);
+  }
+
+  // the jobs and their strings end in one block, freed by destroyJobsData
+  JobData* jobsData = malloc(jobs * sizeof(JobData) + stringsSize);
+  assert(jobsData != NULL);
+  char* jobsStrings = (char*) (jobsData + jobs);
+  memcpy(jobsStrings, strings, stringsSize);
+  for (size_t i = 0; i < jobs; i++) {
+    jobsData[i] = jobData[i];
+    jobsData[i].plateFile = jobsStrings + (jobData[i].plateFile - strings);
+    jobsData[i].directory = jobsStrings;
+  }
+  free(jobData);
+  free(strings);
+  *jobsCount = jobs;
+  return jobsData;
 }
 
-// Code adapted from <https://es.stackoverflow.com/questions/409312/como-leer-un-binario-en-c>
 Plate* readPlate(const char *binaryFilepath, char *directory) {
-  Plate* plate = malloc(sizeof(Plate));
-  FILE *binaryFile;
-  size_t rows, cols;
-  double **matrix;
-  char path[MAX_PATH_SIZE];
-  snprintf(path, MAX_PATH_SIZE, "%s/%s", directory, binaryFilepath);
-  binaryFile = fopen(path, "rb");
-
-  if (!binaryFile) {
+  const size_t pathSize = strlen(directory) + strlen(binaryFilepath) + 2;
+  char* path = malloc(pathSize);
+  assert(path != NULL);
+  snprintf(path, pathSize, "%s/%s", directory, binaryFilepath);
+  int file = open(path, O_RDONLY);
+  struct stat fileInfo;
+
+  if (file < 0 || fstat(file, &fileInfo) != 0) {
     printf("Error opening file %s\n", path);
     exit(EXIT_FAILURE);
   }
 
-  fread(&rows, sizeof(size_t), 1, binaryFile);
-  fread(&cols, sizeof(size_t), 1, binaryFile);
+  // the file is only read, the simulation copies it to padded plates
+  const size_t fileSize = fileInfo.st_size;
+  int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+  flags |= MAP_POPULATE;
+#endif
+  void* mapping = fileSize >= PLATE_HEADER_SIZE ? mmap(NULL, fileSize,
+    PROT_READ, flags, file, 0) : MAP_FAILED;
+  close(file);
+  if (mapping == MAP_FAILED) {
+    printf("Error reading plate from file %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  madvise(mapping, fileSize, MADV_WILLNEED);
 
-  matrix = (double **)malloc(rows * sizeof(double *));
-  for (size_t i = 0; i < rows; i++) {
-    matrix[i] = (double *)malloc(cols * sizeof(double));
-    fread(matrix[i], sizeof(double), cols, binaryFile);
+  if (isCompressedPlate(mapping, fileSize)) {
+    // decoded into a plate of its own, the mapping is not needed after
+    Plate* plate = readCompressedPlate(mapping, fileSize,
+      sysconf(_SC_NPROCESSORS_ONLN));
+    munmap(mapping, fileSize);
+    if (plate == NULL) {
+      printf("Error reading plate from file %s\n", path);
+      exit(EXIT_FAILURE);
+    }
+    free(path);
+    return plate;
   }
 
-  fclose(binaryFile);
-  plate->data = matrix;
+  const size_t rows = ((size_t*) mapping)[0];
+  const size_t cols = ((size_t*) mapping)[1];
+  if ((fileSize - PLATE_HEADER_SIZE) / sizeof(double) < rows * cols) {
+    printf("Error reading plate from file %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+
+  Plate* plate = malloc(sizeof(Plate));
+  assert(plate != NULL);
+  plate->data = (double*) ((char*) mapping + PLATE_HEADER_SIZE);
+  plate->isBalanced = 0;
   plate->rows = rows;
   plate->cols = cols;
-  plate->isBalanced = 0;
+  plate->stride = cols;
+  plate->mappedSize = fileSize;
+  free(path);
   return plate;
 }
 
@@ -145,6 +400,9 @@ void getDirectory(const char *path, char *directory, size_t size) {
 
     if (last_slash != NULL) {
         *last_slash = '\0';
+    } else if (size > 1) {
+        // a job file of the working directory
+        strcpy(directory, ".");
     } else {
         directory[0] = '\0';
     }
@@ -0,0 +1,265 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#include "jobs.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "checkpoint.h"
+#include "input.h"
+#include "output.h"
+#include "plate.h"
+#include "solution.h"
+
+/**
+ * @brief State shared by the reader, the simulation and the writer stages.
+ *
+ * The reader stays at most prefetchCount plates ahead of the started jobs,
+ * and stops while maxPendingPlates plates are read and not yet written, so
+ * a slow disk holds back the reader instead of filling the memory.
+ */
+typedef struct {
+    JobData* jobsData;  /// < the jobs
+    SimulationResult* results;  /// < result of every job, in job order
+    Plate** plates;  /// < plate of every read job that did not start yet,
+        /// NULL if the job ended on a previous run
+    size_t* firstIterations;  /// < iterations already done on every plate,
+        /// or of the result if the job ended on a previous run
+    Arguments args;  /// < the arguments
+    size_t jobsCount;  /// < number of jobs
+    size_t readCount;  /// < jobs whose plate was read
+    size_t startedCount;  /// < jobs handed to a runner
+    size_t pendingPlates;  /// < plates read and not yet written
+    size_t prefetchCount;  /// < plates read ahead of the started jobs
+    size_t maxPendingPlates;  /// < bound of pendingPlates
+    size_t* finishedJobs;  /// < finished jobs, in the order they ended
+    size_t finishedCount;  /// < number of finished jobs
+    size_t freeThreads;  /// < threads not assigned to any job
+    pthread_mutex_t mutex;  /// < protects the counters and the arrays
+    pthread_cond_t plateRead;  /// < signaled when the reader loads a plate
+    pthread_cond_t slotFreed;  /// < signaled when the reader may go on
+    pthread_cond_t jobDone;  /// < signaled when a job releases its threads
+    pthread_cond_t resultReady;  /// < signaled when a job finishes
+} JobPipeline;
+
+/**
+ * @brief A job and the threads it got.
+ */
+typedef struct {
+    size_t jobIndex;  /// < index of the job
+    Plate* plate;  /// < initial plate of the job
+    Arguments args;  /// < arguments, threadsCount is the job share
+    ThreadPool* pool;  /// < workers that run the job
+    JobPipeline* pipeline;  /// < receives the threads and the result
+} JobTask;
+
+static void* readPlates(void* data) {
+  JobPipeline* pipeline = (JobPipeline*) data;
+  for (size_t job = 0; job < pipeline->jobsCount; ++job) {
+    pthread_mutex_lock(&pipeline->mutex);
+    while (job - pipeline->startedCount >= pipeline->prefetchCount
+      || pipeline->pendingPlates >= pipeline->maxPendingPlates) {
+      pthread_cond_wait(&pipeline->slotFreed, &pipeline->mutex);
+    }
+    ++pipeline->pendingPlates;
+    pthread_mutex_unlock(&pipeline->mutex);
+
+    const JobData* jobData = &pipeline->jobsData[job];
+    Plate* plate = NULL;
+    size_t firstIteration = 0;
+    CheckpointStatus status = CHECKPOINT_NONE;
+    if (pipeline->args.shouldResume) {
+      status = loadCheckpoint(jobData, pipeline->args.jobFile, &plate,
+        &firstIteration);
+    }
+    if (status == CHECKPOINT_NONE) {
+      plate = readPlate(jobData->plateFile, jobData->directory);
+      firstIteration = 0;
+    }
+
+    pthread_mutex_lock(&pipeline->mutex);
+    pipeline->plates[job] = plate;
+    pipeline->firstIterations[job] = firstIteration;
+    pipeline->readCount = job + 1;
+    pthread_cond_signal(&pipeline->plateRead);
+    pthread_mutex_unlock(&pipeline->mutex);
+  }
+  return NULL;
+}
+
+static void* writeResults(void* data) {
+  JobPipeline* pipeline = (JobPipeline*) data;
+  ResultStream stream;
+  openResultStream(&stream, pipeline->jobsData, pipeline->results,
+    pipeline->jobsCount, pipeline->args.shouldCompress
+    ? pipeline->args.threadsCount : 0);
+
+  for (size_t written = 0; written < pipeline->jobsCount; ++written) {
+    pthread_mutex_lock(&pipeline->mutex);
+    while (pipeline->finishedCount == written) {
+      pthread_cond_wait(&pipeline->resultReady, &pipeline->mutex);
+    }
+    const size_t job = pipeline->finishedJobs[written];
+    pthread_mutex_unlock(&pipeline->mutex);
+
+    commitJobResult(&stream, job);
+    if (pipeline->results[job].plate != NULL) {
+      destroyPlate(pipeline->results[job].plate);
+      pipeline->results[job].plate = NULL;
+    }
+    if (isCheckpointing(&pipeline->args)) {
+      markCheckpointDone(&pipeline->jobsData[job], pipeline->args.jobFile,
+        pipeline->results[job].iterations);
+    }
+
+    pthread_mutex_lock(&pipeline->mutex);
+    --pipeline->pendingPlates;
+    pthread_cond_signal(&pipeline->slotFreed);
+    pthread_mutex_unlock(&pipeline->mutex);
+  }
+
+  // once every result is on disk, the checkpoints would only let a later
+  // --resume skip the jobs
+  if (closeResultStream(&stream) && isCheckpointing(&pipeline->args)) {
+    for (size_t job = 0; job < pipeline->jobsCount; ++job) {
+      removeCheckpoint(&pipeline->jobsData[job]);
+    }
+  }
+  return NULL;
+}
+
+static void* runJob(void* data) {
+  JobTask* task = (JobTask*) data;
+  JobPipeline* pipeline = task->pipeline;
+  const SimulationResult result = simulate(
+    pipeline->jobsData[task->jobIndex], task->plate,
+    pipeline->firstIterations[task->jobIndex], task->args, task->pool);
+
+  pthread_mutex_lock(&pipeline->mutex);
+  pipeline->results[task->jobIndex] = result;
+  pipeline->freeThreads += task->args.threadsCount;
+  pipeline->finishedJobs[pipeline->finishedCount++] = task->jobIndex;
+  pthread_cond_signal(&pipeline->jobDone);
+  pthread_cond_signal(&pipeline->resultReady);
+  pthread_mutex_unlock(&pipeline->mutex);
+  return NULL;
+}
+
+size_t calcJobThreads(size_t cells, size_t threadBudget) {
+  const size_t threads = (cells + MIN_CELLS_PER_THREAD - 1)
+    / MIN_CELLS_PER_THREAD;
+  if (threads == 0) {
+    return 1;
+  }
+  return threads < threadBudget ? threads : threadBudget;
+}
+
+static void startStage(pthread_t* thread, void* (*routine)(void* data),
+  JobPipeline* pipeline) {
+  if (pthread_create(thread, NULL, routine, pipeline) != EXIT_SUCCESS) {
+    fprintf(stderr, "Error: could not create pipeline thread\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void runJobs(JobData* jobsData, SimulationResult* results, size_t jobsCount,
+  Arguments args, ThreadPool* pool) {
+  if (jobsCount == 0) {
+    return;
+  }
+  const size_t threadBudget = args.threadsCount;
+  JobPipeline pipeline;
+  pipeline.jobsData = jobsData;
+  pipeline.results = results;
+  pipeline.jobsCount = jobsCount;
+  pipeline.plates = calloc(jobsCount, sizeof(Plate*));
+  pipeline.firstIterations = calloc(jobsCount, sizeof(size_t));
+  pipeline.finishedJobs = malloc(jobsCount * sizeof(size_t));
+  assert(pipeline.plates != NULL && pipeline.firstIterations != NULL
+    && pipeline.finishedJobs != NULL);
+  pipeline.args = args;
+  pipeline.readCount = 0;
+  pipeline.startedCount = 0;
+  pipeline.pendingPlates = 0;
+  pipeline.prefetchCount = args.prefetchCount;
+  // every thread may run a job, plus the prefetched plates
+  pipeline.maxPendingPlates = threadBudget + args.prefetchCount;
+  pipeline.finishedCount = 0;
+  pipeline.freeThreads = threadBudget;
+  pthread_mutex_init(&pipeline.mutex, NULL);
+  pthread_cond_init(&pipeline.plateRead, NULL);
+  pthread_cond_init(&pipeline.slotFreed, NULL);
+  pthread_cond_init(&pipeline.jobDone, NULL);
+  pthread_cond_init(&pipeline.resultReady, NULL);
+
+  JobTask* tasks = malloc(jobsCount * sizeof(JobTask));
+  assert(tasks != NULL);
+  pthread_attr_t attributes;
+  pthread_attr_init(&attributes);
+  pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+
+  pthread_t reader, writer;
+  startStage(&reader, readPlates, &pipeline);
+  startStage(&writer, writeResults, &pipeline);
+
+  for (size_t i = 0; i < jobsCount; i++) {
+    pthread_mutex_lock(&pipeline.mutex);
+    while (pipeline.readCount <= i) {
+      pthread_cond_wait(&pipeline.plateRead, &pipeline.mutex);
+    }
+    tasks[i].jobIndex = i;
+    tasks[i].plate = pipeline.plates[i];
+    pipeline.plates[i] = NULL;
+    if (tasks[i].plate == NULL) {
+      // the job ended on a previous run, only its TSV line is missing
+      results[i].plate = NULL;
+      results[i].iterations = pipeline.firstIterations[i];
+      pipeline.finishedJobs[pipeline.finishedCount++] = i;
+      pipeline.startedCount = i + 1;
+      pthread_cond_signal(&pipeline.resultReady);
+      pthread_cond_signal(&pipeline.slotFreed);
+      pthread_mutex_unlock(&pipeline.mutex);
+      continue;
+    }
+    tasks[i].args = args;
+    tasks[i].args.threadsCount = calcJobThreads(tasks[i].plate->rows
+      * tasks[i].plate->cols, threadBudget);
+    tasks[i].pool = pool;
+    tasks[i].pipeline = &pipeline;
+
+    // jobs start in order, so a big plate is not starved by small ones
+    while (pipeline.freeThreads < tasks[i].args.threadsCount) {
+      pthread_cond_wait(&pipeline.jobDone, &pipeline.mutex);
+    }
+    pipeline.freeThreads -= tasks[i].args.threadsCount;
+    pipeline.startedCount = i + 1;
+    pthread_cond_signal(&pipeline.slotFreed);
+    pthread_mutex_unlock(&pipeline.mutex);
+
+    pthread_t runner;
+    if (pthread_create(&runner, &attributes, runJob, &tasks[i])
+      != EXIT_SUCCESS) {
+      fprintf(stderr, "Error: could not create job thread\n");
+      runJob(&tasks[i]);
+    }
+  }
+
+  pthread_join(reader, NULL);
+  pthread_join(writer, NULL);
+  // every job gives its threads back when it ends
+  pthread_mutex_lock(&pipeline.mutex);
+  while (pipeline.freeThreads < threadBudget) {
+    pthread_cond_wait(&pipeline.jobDone, &pipeline.mutex);
+  }
+  pthread_mutex_unlock(&pipeline.mutex);
+
+  pthread_attr_destroy(&attributes);
+  pthread_cond_destroy(&pipeline.resultReady);
+  pthread_cond_destroy(&pipeline.jobDone);
+  pthread_cond_destroy(&pipeline.slotFreed);
+  pthread_cond_destroy(&pipeline.plateRead);
+  pthread_mutex_destroy(&pipeline.mutex);
+  free(pipeline.plates);
+  free(pipeline.firstIterations);
+  free(pipeline.finishedJobs);
+  free(tasks);
+}
@@ -0,0 +1,80 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#include "plate.h"
+#include <assert.h>
+#include <string.h>
+
+size_t calcPlateStride(size_t cols) {
+  const size_t cellsPerLine = PLATE_ALIGNMENT / sizeof(double);
+  return (cols + cellsPerLine - 1) / cellsPerLine * cellsPerLine;
+}
+
+Plate* createPlate(size_t rows, size_t cols) {
+  return createPlateStrided(rows, cols, calcPlateStride(cols));
+}
+
+Plate* createPlateStrided(size_t rows, size_t cols, size_t stride) {
+  Plate* plate = allocatePlate(rows, cols, stride);
+  // clean the padding so whole-buffer copies never read garbage
+  if (plate->stride != cols) {
+    for (size_t row = 0; row < rows; row++) {
+      memset(PLATE_ROW(plate, row) + cols, 0,
+        (plate->stride - cols) * sizeof(double));
+    }
+  }
+  return plate;
+}
+
+Plate* allocatePlate(size_t rows, size_t cols, size_t stride) {
+  Plate* plate = malloc(sizeof(Plate));
+  assert(plate != NULL);
+  plate->rows = rows;
+  plate->cols = cols;
+  plate->stride = stride;
+  plate->isBalanced = 0;
+  plate->mappedSize = 0;
+  // aligned_alloc wants a multiple of the alignment, any stride may be given
+  size_t size = rows * plate->stride * sizeof(double);
+  size = (size + PLATE_ALIGNMENT - 1) / PLATE_ALIGNMENT * PLATE_ALIGNMENT;
+  plate->data = aligned_alloc(PLATE_ALIGNMENT, size > 0 ? size
+    : PLATE_ALIGNMENT);
+  if (plate->data == NULL) {
+    fprintf(stderr, "Error: could not allocate a %zux%zu plate\n", rows, cols);
+    exit(EXIT_FAILURE);
+  }
+  return plate;
+}
+
+void copyPlateRows(const Plate* source, Plate* target, size_t firstRow,
+  size_t endRow) {
+  for (size_t row = firstRow; row < endRow; ++row) {
+    memcpy(PLATE_ROW(target, row), PLATE_ROW(source, row),
+      source->cols * sizeof(double));
+    memset(PLATE_ROW(target, row) + target->cols, 0,
+      (target->stride - target->cols) * sizeof(double));
+  }
+}
+
+float* createFloatCells(const Plate* plate) {
+  const size_t size = plate->rows * plate->stride * sizeof(float);
+  float* cells = aligned_alloc(PLATE_ALIGNMENT, (size + PLATE_ALIGNMENT - 1)
+    / PLATE_ALIGNMENT * PLATE_ALIGNMENT + PLATE_ALIGNMENT);
+  if (cells == NULL) {
+    fprintf(stderr, "Error: could not allocate a %zux%zu plate\n",
+      plate->rows, plate->cols);
+    exit(EXIT_FAILURE);
+  }
+  for (size_t index = 0; index < plate->rows * plate->stride; index++) {
+    cells[index] = (float) plate->data[index];
+  }
+  return cells;
+}
+
+void copyFloatInterior(const float* cells, Plate* plate) {
+  for (size_t row = 1; row + 1 < plate->rows; row++) {
+    const float* source = cells + row * plate->stride;
+    double* target = PLATE_ROW(plate, row);
+    for (size_t col = 1; col + 1 < plate->cols; col++) {
+      target[col] = source[col];
+    }
+  }
+}
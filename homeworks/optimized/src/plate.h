@@ -0,0 +1,98 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#pragma once
+#include <stdlib.h>
+#include "types.h"
+
+/// Alignment in bytes of the plate buffer and of the start of every row
+#define PLATE_ALIGNMENT 64
+
+/// Bytes before the cells in a plate file, the rows and cols counts
+#define PLATE_HEADER_SIZE (2 * sizeof(size_t))
+
+/// Pointer to the first cell of the given row of a plate
+#define PLATE_ROW(plate, row) ((plate)->data + (row) * (plate)->stride)
+
+/**
+ * @brief Calculates the padded length of a plate row.
+ *
+ * Rows are padded up to a multiple of PLATE_ALIGNMENT bytes so every row of
+ * the contiguous buffer starts on a cache line boundary.
+ *
+ * @param cols The number of columns of the plate.
+ * @return The number of doubles between the start of two consecutive rows.
+ */
+size_t calcPlateStride(size_t cols);
+
+/**
+ * @brief Creates a plate backed by a single contiguous, aligned buffer.
+ *
+ * The cells are stored row-major with a padded stride. The padding at the end
+ * of each row is zeroed, the cells are left uninitialized.
+ *
+ * @param rows The number of rows of the plate.
+ * @param cols The number of columns of the plate.
+ * @return A pointer to the new plate.
+ */
+Plate* createPlate(size_t rows, size_t cols);
+
+/**
+ * @brief Creates a plate with the given row stride.
+ *
+ * Same as createPlate, for a plate that must share the layout of another
+ * one, e.g. a snapshot of a plate.
+ *
+ * @param rows The number of rows of the plate.
+ * @param cols The number of columns of the plate.
+ * @param stride The number of doubles between two rows, at least cols.
+ * @return A pointer to the new plate.
+ */
+Plate* createPlateStrided(size_t rows, size_t cols, size_t stride);
+
+/**
+ * @brief Creates a plate without touching its buffer.
+ *
+ * Neither the cells nor the padding are written, so the pages of every row
+ * land on the NUMA node of the thread that writes them first. The caller
+ * fills the cells and zeroes the padding, ideally from the threads that
+ * will later update those rows.
+ *
+ * @param rows The number of rows of the plate.
+ * @param cols The number of columns of the plate.
+ * @param stride The number of doubles between two rows, at least cols.
+ * @return A pointer to the new plate.
+ */
+Plate* allocatePlate(size_t rows, size_t cols, size_t stride);
+
+/**
+ * @brief Copies some rows of a plate into another one of the same size.
+ *
+ * The padding of the copied rows of the target is zeroed. Used to fill a
+ * plate from allocatePlate with the rows each thread will update.
+ *
+ * @param source The plate to copy from, any stride.
+ * @param target The plate to copy to, any stride.
+ * @param firstRow The first row to copy.
+ * @param endRow The row after the last one to copy.
+ */
+void copyPlateRows(const Plate* source, Plate* target, size_t firstRow,
+  size_t endRow);
+
+/**
+ * @brief Copies a plate into a single precision buffer.
+ *
+ * The buffer has the same row stride as the plate, in floats.
+ *
+ * @param plate The plate to convert.
+ * @return A new PLATE_ALIGNMENT aligned buffer of rows * stride floats.
+ */
+float* createFloatCells(const Plate* plate);
+
+/**
+ * @brief Copies the interior cells of a single precision buffer to a plate.
+ *
+ * The borders of the plate keep their exact double values.
+ *
+ * @param cells A buffer with the layout of createFloatCells.
+ * @param plate The plate that receives the cells.
+ */
+void copyFloatInterior(const float* cells, Plate* plate);
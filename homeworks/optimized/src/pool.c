@@ -0,0 +1,137 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#define _GNU_SOURCE
+#include "pool.h"
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "solution.h"
+
+static void* runWorker(void* data) {
+  const struct private_data* self = (struct private_data*) data;
+  ThreadPool* pool = (ThreadPool*) self->data;
+  const size_t worker = self->thread_number;
+
+  pthread_mutex_lock(&pool->mutex);
+  while (1) {
+    while (pool->regions[worker] == NULL && !pool->isStopping) {
+      pthread_cond_wait(&pool->regionReady, &pool->mutex);
+    }
+    if (pool->regions[worker] == NULL) {
+      break;
+    }
+    PoolRegion* region = pool->regions[worker];
+    struct private_data regionData = *self;
+    regionData.thread_number = pool->ranks[worker];
+    regionData.thread_count = region->threadCount;
+    regionData.data = region->data;
+    pthread_mutex_unlock(&pool->mutex);
+
+    region->routine(&regionData);
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->regions[worker] = NULL;
+    ++pool->idleCount;
+    --region->pendingThreads;
+    pthread_cond_broadcast(&pool->regionDone);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+  return NULL;
+}
+
+static void pinWorkers(ThreadPool* pool) {
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    return;
+  }
+  const int cpuCount = CPU_COUNT(&allowed);
+  for (size_t thread = 0; thread < pool->threadCount; ++thread) {
+    // the (thread % cpuCount)-th allowed CPU
+    int skip = thread % cpuCount;
+    int cpu = 0;
+    while (!CPU_ISSET(cpu, &allowed) || skip-- > 0) {
+      ++cpu;
+    }
+    cpu_set_t target;
+    CPU_ZERO(&target);
+    CPU_SET(cpu, &target);
+    if (pthread_setaffinity_np(pool->team[thread].thread_id, sizeof(target),
+      &target) != 0) {
+      fprintf(stderr, "Warning: could not pin thread %zu\n", thread);
+    }
+  }
+}
+
+ThreadPool* createThreadPool(size_t threadCount, short shouldPin) {
+  ThreadPool* pool = malloc(sizeof(ThreadPool));
+  if (pool == NULL) {
+    return NULL;
+  }
+  pool->threadCount = threadCount;
+  pool->regions = calloc(threadCount, sizeof(PoolRegion*));
+  pool->ranks = calloc(threadCount, sizeof(size_t));
+  pool->idleCount = threadCount;
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->regionReady, NULL);
+  pthread_cond_init(&pool->regionDone, NULL);
+  pool->isStopping = 0;
+
+  pool->team = pool->regions && pool->ranks
+    ? create_threads(threadCount, runWorker, pool) : NULL;
+  if (pool->team == NULL) {
+    pthread_cond_destroy(&pool->regionDone);
+    pthread_cond_destroy(&pool->regionReady);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool->regions);
+    free(pool->ranks);
+    free(pool);
+    return NULL;
+  }
+  if (shouldPin) {
+    pinWorkers(pool);
+  }
+  return pool;
+}
+
+void runParallel(ThreadPool* pool, size_t threadCount,
+  void* (*routine)(void* data), void* data) {
+  PoolRegion region;
+  region.routine = routine;
+  region.data = data;
+  region.threadCount = threadCount < pool->threadCount ? threadCount
+    : pool->threadCount;
+  region.pendingThreads = region.threadCount;
+
+  pthread_mutex_lock(&pool->mutex);
+  while (pool->idleCount < region.threadCount) {
+    pthread_cond_wait(&pool->regionDone, &pool->mutex);
+  }
+  // hand the region to the first idle workers
+  size_t rank = 0;
+  for (size_t worker = 0; rank < region.threadCount; ++worker) {
+    if (pool->regions[worker] == NULL) {
+      pool->regions[worker] = &region;
+      pool->ranks[worker] = rank++;
+    }
+  }
+  pool->idleCount -= region.threadCount;
+  pthread_cond_broadcast(&pool->regionReady);
+  while (region.pendingThreads > 0) {
+    pthread_cond_wait(&pool->regionDone, &pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+void destroyThreadPool(ThreadPool* pool) {
+  pthread_mutex_lock(&pool->mutex);
+  pool->isStopping = 1;
+  pthread_cond_broadcast(&pool->regionReady);
+  pthread_mutex_unlock(&pool->mutex);
+
+  join_threads(pool->threadCount, pool->team);
+  pthread_cond_destroy(&pool->regionDone);
+  pthread_cond_destroy(&pool->regionReady);
+  pthread_mutex_destroy(&pool->mutex);
+  free(pool->regions);
+  free(pool->ranks);
+  free(pool);
+}
@@ -0,0 +1,67 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#pragma once
+#include <pthread.h>
+#include <stddef.h>
+#include "types.h"
+
+/**
+ * @struct PoolRegion
+ * @brief A routine run by a group of workers of the pool.
+ */
+typedef struct {
+    void* (*routine)(void* data);  /// < routine run by every worker
+    void* data;  /// < data of the region
+    size_t threadCount;  /// < workers that run the region
+    size_t pendingThreads;  /// < workers still running the region
+} PoolRegion;
+
+/**
+ * @struct ThreadPool
+ * @brief Team of worker threads created once and reused by every job.
+ *
+ * Workers park on a condition variable between parallel regions. Several
+ * regions may run at once on disjoint groups of idle workers. Every worker
+ * of a region gets a private_data with its rank in the region, the region
+ * thread count and the region data.
+ */
+typedef struct {
+    size_t threadCount;  /// < number of workers
+    struct private_data* team;  /// < the workers
+    PoolRegion** regions;  /// < region of every worker, NULL if idle
+    size_t* ranks;  /// < rank of every worker in its region
+    size_t idleCount;  /// < workers without a region
+    pthread_mutex_t mutex;  /// < protects the pool fields
+    pthread_cond_t regionReady;  /// < signaled when a region starts
+    pthread_cond_t regionDone;  /// < signaled when workers become idle
+    short isStopping;  /// < indicates the workers must exit
+} ThreadPool;
+
+/**
+ * @brief Creates a pool of parked workers.
+ *
+ * @param threadCount The number of workers.
+ * @param shouldPin Whether worker i is pinned to the i-th allowed CPU.
+ * @return The pool, or NULL if the workers could not be created.
+ */
+ThreadPool* createThreadPool(size_t threadCount, short shouldPin);
+
+/**
+ * @brief Runs a routine on threadCount idle workers and waits for them.
+ *
+ * Waits for enough idle workers if other regions are running. Several
+ * threads may call it at the same time.
+ *
+ * @param pool The pool.
+ * @param threadCount Workers that run the routine, at most the pool size.
+ * @param routine The routine, it receives a struct private_data*.
+ * @param data The data of the region.
+ */
+void runParallel(ThreadPool* pool, size_t threadCount,
+  void* (*routine)(void* data), void* data);
+
+/**
+ * @brief Stops the workers and frees the pool.
+ *
+ * @param pool The pool.
+ */
+void destroyThreadPool(ThreadPool* pool);
@@ -0,0 +1,142 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#include "schedule.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RANGE_BITS 32
+#define RANGE_MASK ((UINT64_C(1) << RANGE_BITS) - 1)
+
+static inline uint_least64_t packRange(size_t begin, size_t end) {
+  return (uint_least64_t) begin << RANGE_BITS | (uint_least64_t) end;
+}
+
+static inline size_t maxOf(size_t first, size_t second) {
+  return first > second ? first : second;
+}
+
+int findSchedulePolicy(const char* name, SchedulePolicy* policy) {
+  if (strcmp(name, "guided") == 0) {
+    *policy = SCHEDULE_GUIDED;
+    return 1;
+  }
+  if (strcmp(name, "steal") == 0) {
+    *policy = SCHEDULE_STEAL;
+    return 1;
+  }
+  return 0;
+}
+
+void initWorkQueue(WorkQueue* queue, SchedulePolicy policy,
+  size_t unitsCount, size_t threadCount) {
+  assert(unitsCount <= RANGE_MASK);
+  queue->policy = policy;
+  queue->unitsCount = unitsCount;
+  queue->threadCount = threadCount;
+  queue->ranges = NULL;
+  if (policy == SCHEDULE_STEAL) {
+    queue->ranges = aligned_alloc(_Alignof(WorkRange),
+      threadCount * sizeof(WorkRange));
+    assert(queue->ranges != NULL);
+  }
+  resetWorkQueue(queue);
+}
+
+void resetWorkQueue(WorkQueue* queue) {
+  atomic_store_explicit(&queue->nextUnit, 0, memory_order_relaxed);
+  if (queue->policy == SCHEDULE_STEAL) {
+    // every thread starts with its block of the units
+    for (size_t thread = 0; thread < queue->threadCount; ++thread) {
+      atomic_store_explicit(&queue->ranges[thread].bounds, packRange(
+        thread * queue->unitsCount / queue->threadCount,
+        (thread + 1) * queue->unitsCount / queue->threadCount),
+        memory_order_relaxed);
+    }
+  }
+}
+
+static int claimGuided(WorkQueue* queue, size_t* begin, size_t* end) {
+  const size_t total = queue->unitsCount;
+  size_t next = atomic_load_explicit(&queue->nextUnit, memory_order_relaxed);
+  if (next >= total) {
+    return 0;
+  }
+  // the chunk shrinks with the work left, the estimate may be stale
+  const size_t chunk = maxOf(MIN_CHUNK_UNITS,
+    (total - next) / (2 * queue->threadCount));
+  *begin = atomic_fetch_add_explicit(&queue->nextUnit, chunk,
+    memory_order_relaxed);
+  if (*begin >= total) {
+    return 0;
+  }
+  *end = *begin + chunk < total ? *begin + chunk : total;
+  return 1;
+}
+
+static int claimOwn(WorkRange* range, size_t* begin, size_t* end) {
+  uint_least64_t bounds = atomic_load_explicit(&range->bounds,
+    memory_order_relaxed);
+  while (1) {
+    const size_t first = bounds >> RANGE_BITS;
+    const size_t last = bounds & RANGE_MASK;
+    if (first >= last) {
+      return 0;
+    }
+    // the owner takes from the front
+    const size_t chunk = maxOf(MIN_CHUNK_UNITS,
+      (last - first) / OWNER_CHUNK_DIVISOR);
+    if (atomic_compare_exchange_weak_explicit(&range->bounds, &bounds,
+      packRange(first + chunk, last), memory_order_relaxed,
+      memory_order_relaxed)) {
+      *begin = first;
+      *end = first + chunk;
+      return 1;
+    }
+  }
+}
+
+static int steal(WorkRange* range, size_t* begin, size_t* end) {
+  uint_least64_t bounds = atomic_load_explicit(&range->bounds,
+    memory_order_relaxed);
+  while (1) {
+    const size_t first = bounds >> RANGE_BITS;
+    const size_t last = bounds & RANGE_MASK;
+    if (first >= last) {
+      return 0;
+    }
+    // thieves take the back half
+    const size_t chunk = (last - first + 1) / 2;
+    if (atomic_compare_exchange_weak_explicit(&range->bounds, &bounds,
+      packRange(first, last - chunk), memory_order_relaxed,
+      memory_order_relaxed)) {
+      *begin = last - chunk;
+      *end = last;
+      return 1;
+    }
+  }
+}
+
+int claimWork(WorkQueue* queue, size_t threadNumber, size_t* begin,
+  size_t* end) {
+  if (queue->policy == SCHEDULE_GUIDED) {
+    return claimGuided(queue, begin, end);
+  }
+
+  if (claimOwn(&queue->ranges[threadNumber], begin, end)) {
+    return 1;
+  }
+  // ranges only shrink during an iteration, one sweep finds any work left
+  for (size_t offset = 1; offset < queue->threadCount; ++offset) {
+    const size_t victim = (threadNumber + offset) % queue->threadCount;
+    if (steal(&queue->ranges[victim], begin, end)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void destroyWorkQueue(WorkQueue* queue) {
+  free(queue->ranges);
+  queue->ranges = NULL;
+}
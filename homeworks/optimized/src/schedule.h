@@ -0,0 +1,90 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#pragma once
+#include <stdatomic.h>
+#include <stddef.h>
+
+/// Smallest chunk of work units claimed at once
+#define MIN_CHUNK_UNITS 1
+
+/// A thread takes 1/OWNER_CHUNK_DIVISOR of what is left in its own range
+#define OWNER_CHUNK_DIVISOR 4
+
+/**
+ * @enum SchedulePolicy
+ * @brief How the dynamic mapping hands work units to the threads.
+ */
+typedef enum {
+    SCHEDULE_GUIDED,  /// < one shared counter, chunks shrink as work ends
+    SCHEDULE_STEAL,  /// < one range per thread, idle threads steal halves
+} SchedulePolicy;
+
+/**
+ * @struct WorkRange
+ * @brief Range of work units of one thread, in its own cache line.
+ *
+ * The first unit is in the upper 32 bits and the end in the lower 32 bits,
+ * so the owner and the thieves update it with a single compare and swap.
+ */
+typedef struct {
+    _Alignas(64) atomic_uint_least64_t bounds;  /// < packed [begin, end)
+} WorkRange;
+
+/**
+ * @struct WorkQueue
+ * @brief Hands out chunks of work units, numbered 0 to unitsCount - 1.
+ */
+typedef struct {
+    SchedulePolicy policy;  /// < how the units are handed out
+    size_t unitsCount;  /// < units to process on every iteration
+    size_t threadCount;  /// < threads that claim units
+    _Alignas(64) atomic_size_t nextUnit;  /// < first unclaimed unit, guided
+    WorkRange* ranges;  /// < range of every thread, steal
+} WorkQueue;
+
+/**
+ * @brief Gets the policy with the given name.
+ *
+ * @param name "guided" or "steal".
+ * @param policy Receives the policy.
+ * @return 1 if the name is known, 0 otherwise.
+ */
+int findSchedulePolicy(const char* name, SchedulePolicy* policy);
+
+/**
+ * @brief Initializes a work queue with every unit unclaimed.
+ *
+ * @param queue The queue.
+ * @param policy How the units are handed out.
+ * @param unitsCount The number of units, less than 2^32.
+ * @param threadCount The number of threads that claim units.
+ */
+void initWorkQueue(WorkQueue* queue, SchedulePolicy policy,
+  size_t unitsCount, size_t threadCount);
+
+/**
+ * @brief Makes every unit unclaimed again for the next iteration.
+ *
+ * Must not run while threads claim units, e.g. run it in a barrier action.
+ *
+ * @param queue The queue.
+ */
+void resetWorkQueue(WorkQueue* queue);
+
+/**
+ * @brief Claims the next chunk of units for a thread.
+ *
+ * @param queue The queue.
+ * @param threadNumber The number of the calling thread.
+ * @param begin Receives the first unit of the chunk.
+ * @param end Receives the unit after the last one of the chunk.
+ * @return 1 if a chunk was claimed, 0 if every unit is claimed.
+ */
+int claimWork(WorkQueue* queue, size_t threadNumber, size_t* begin,
+  size_t* end);
+
+/**
+ * @brief Frees the resources of a work queue.
+ *
+ * @param queue The queue.
+ */
+void destroyWorkQueue(WorkQueue* queue);
@@ -2,6 +2,7 @@
 #define _POSIX_C_SOURCE 199309L
 
 #include <assert.h>
+#include <float.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,8 +10,14 @@
 #include <math.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/mman.h>
 
+#include "blocking.h"
+#include "checkpoint.h"
 #include "input.h"
+#include "jobs.h"
+#include "plate.h"
+#include "pool.h"
 #include "solution.h"
 #include "output.h"
 
@@ -23,18 +30,23 @@ int main(int argc, char** argv) {
     struct timespec start, end;
   clock_gettime(CLOCK_MONOTONIC, &start);
   Arguments args = processArguments(argc, argv);
-  JobData* jobsData = readJobData(args.jobFile);
-  size_t jobsCount = calcFileLinesCount(args.jobFile);
+  size_t jobsCount = 0;
+  JobData* jobsData = readJobData(args.jobFile, &jobsCount);
   SimulationResult* results = malloc(jobsCount * sizeof(SimulationResult));
   assert(results != NULL);
-  for (size_t i = 0; i < jobsCount; i++) {
-    results[i] = processJob(jobsData[i], args);
+  // the workers are created once and park between jobs
+  ThreadPool* pool = createThreadPool(args.threadsCount,
+    args.shouldPinThreads);
+  if (pool == NULL) {
+    return EXIT_FAILURE;
   }
-
-  writeJobsResult(jobsData, results, jobsCount, "output.txt");
+  // several jobs run at once, each one with a share of the workers, and
+  // their results are written as they end
+  runJobs(jobsData, results, jobsCount, args, pool);
+  destroyThreadPool(pool);
 
   // free memory
-  destroyJobsData(jobsData, jobsCount);
+  destroyJobsData(jobsData);
   destroySimulationResult(results, jobsCount);
 
   clock_gettime(CLOCK_MONOTONIC, &end);
@@ -45,230 +57,459 @@ int main(int argc, char** argv) {
   return EXIT_SUCCESS;
 }
 
-SimulationResult processJob(JobData jobData, Arguments args) {
+SimulationResult processJob(JobData jobData, Arguments args,
+  ThreadPool* pool) {
   Plate* plate = readPlate(jobData.plateFile, jobData.directory);
-  SimulationResult result = simulate(jobData, plate, args);
+  SimulationResult result = simulate(jobData, plate, 0, args, pool);
   return result;
 }
 
-SimulationResult simulate(JobData jobData, Plate* plate, Arguments args) {
-  Plate* readPlate = copyPlate(plate);
-  Plate* writePlate = plate;
+// Creates the float plates and the change that ends the float steps
+static void startFloatSteps(SharedData* sharedData) {
+    const Plate* plate = sharedData->readPlate;
+    sharedData->floatCells[0] = createFloatCells(plate);
+    sharedData->floatCells[1] = createFloatCells(plate);
+
+    // float changes smaller than a few ulps of the hottest cell are noise
+    double hottest = 0.0;
+    for (size_t index = 0; index < plate->rows * plate->stride; ++index) {
+      const double temperature = plate->data[index] < 0 ? -plate->data[index]
+        : plate->data[index];
+      hottest = temperature > hottest ? temperature : hottest;
+    }
+    const double noise = hottest * FLT_EPSILON * MIXED_NOISE_ULPS;
+    const double threshold = MIXED_SWITCH_FACTOR
+      * sharedData->jobData.balancePoint;
+    sharedData->floatThreshold = threshold > noise ? threshold : noise;
+}
+
+// Copies a band of rows of the initial plate to both plates, so the pages
+// of the copies are first touched by the worker that will update them
+static void* fillPlates(void* data) {
+    const struct private_data* privateData = (struct private_data*) data;
+    SharedData* sharedData = (SharedData*) privateData->data;
+    const Plate* source = sharedData->initialPlate;
+    const size_t threadNumber = privateData->thread_number;
+    const size_t threadCount = privateData->thread_count;
+    const size_t startRow = threadNumber * source->rows / threadCount;
+    const size_t endRow = (threadNumber + 1) * source->rows / threadCount;
+    copyPlateRows(source, sharedData->readPlate, startRow, endRow);
+    copyPlateRows(source, sharedData->writePlate, startRow, endRow);
+    return NULL;
+}
+
+SimulationResult simulate(JobData jobData, Plate* plate,
+  size_t firstIteration, Arguments args, ThreadPool* pool) {
+  // the plate may be the read-only file mapping, the simulation runs on
+  // padded, aligned copies of it
+  const size_t stride = calcPlateStride(plate->cols);
+  Plate* readPlate = allocatePlate(plate->rows, plate->cols, stride);
+  Plate* writePlate = allocatePlate(plate->rows, plate->cols, stride);
   const size_t totalCells = readPlate->rows * readPlate->cols;
-  SharedData* sharedData = malloc(sizeof(SharedData));
+  // aligned so the work counters keep their own cache lines
+  SharedData* sharedData = aligned_alloc(_Alignof(SharedData),
+    sizeof(SharedData));
+  sharedData->initialPlate = plate;
   sharedData->readPlate = readPlate;
   sharedData->writePlate = writePlate;
   sharedData->threadCount = args.threadsCount > totalCells ? totalCells
     : args.threadsCount;
+  runParallel(pool, sharedData->threadCount, fillPlates, sharedData);
+  // the file is not needed any more
+  destroyPlate(plate);
+  sharedData->initialPlate = NULL;
   sharedData->jobData = jobData;
-  sharedData->totalIterations = 0;
-  sharedData->currentCell = 0;
-
-  // init concurrency controls
-    pthread_mutex_init(&sharedData->can_accsess_isBalanced, NULL);
-    pthread_mutex_init(&sharedData->barrierMutex, NULL);
-    pthread_mutex_init(&sharedData->can_accsess_currentCell, NULL);
-    sem_init(&sharedData->turnstile1, 0, 0);
-    sem_init(&sharedData->turnstile2, 0, 1);
-    sharedData->barrierCount = 0;
+  sharedData->totalIterations = firstIteration;
+  sharedData->stencilKernel = args.stencilKernel;
+  // the barrier marks the write plate once the team agrees it is balanced
+  readPlate->isBalanced = 0;
+  writePlate->isBalanced = 0;
+
+  // block mapping: the given tile size, or one sized for the caches
+  if (args.tileRows != 0) {
+    sharedData->tilePlan = planTiles(readPlate->rows, readPlate->cols,
+      args.tileRows, args.tileCols);
+  } else {
+    sharedData->tilePlan = planCacheTiles(readPlate->rows, readPlate->cols);
+#ifndef CYCLIC_MAPPING
+    // dynamic mapping: one row segment per unit, so chunks balance finely
+    sharedData->tilePlan = planTiles(readPlate->rows, readPlate->cols, 1,
+      sharedData->tilePlan.tileCols);
+#endif
+  }
+  initWorkQueue(&sharedData->workQueue, args.schedulePolicy,
+    sharedData->tilePlan.tilesCount, sharedData->threadCount);
+
+  // active tiles: every tile counts as changed before the first step
+  sharedData->changedTiles[0] = NULL;
+  sharedData->changedTiles[1] = NULL;
+  if (args.shouldSkipSteadyTiles) {
+    for (size_t step = 0; step < 2; ++step) {
+      // one extra byte, so a plate without tiles does not malloc(0)
+      sharedData->changedTiles[step] = malloc(
+        sharedData->tilePlan.tilesCount + 1);
+      assert(sharedData->changedTiles[step] != NULL);
+      memset(sharedData->changedTiles[step], 1,
+        sharedData->tilePlan.tilesCount);
+    }
+  }
 
-    struct private_data* team = create_threads(sharedData->threadCount,
-      calcNewTemperature, sharedData);
+  // temporal blocking: tiles that fit in half of the L2 cache
+  void* (*routine)(void* data) = calcNewTemperature;
+  sharedData->stepDeltas = NULL;
+  if (args.timeBlockSteps > 1) {
+    sharedData->timeBlocking = planTimeBlocking(readPlate->rows,
+      readPlate->cols, args.timeBlockSteps, getCacheSize(
+      _SC_LEVEL2_CACHE_SIZE, DEFAULT_TILE_CACHE_SIZE * 2) / 2);
+    sharedData->blockSteps = args.timeBlockSteps;
+    sharedData->isFinishing = 0;
+    sharedData->stepDeltas = calloc(sharedData->threadCount
+      * args.timeBlockSteps, sizeof(double));
+    assert(sharedData->stepDeltas != NULL);
+    routine = calcNewTemperatureBlocked;
+  }
 
+  // init concurrency controls
+    initBarrier(&sharedData->barrier, sharedData->threadCount);
+
+    // a resumed job was checkpointed after its float steps
+    if (args.isMixedPrecision && firstIteration == 0) {
+      // float steps until the plate nears the balance, then double ones
+      startFloatSteps(sharedData);
+      runParallel(pool, sharedData->threadCount, calcNewTemperatureFloat,
+        sharedData);
+      copyFloatInterior(sharedData->floatCells[0], sharedData->readPlate);
+      free(sharedData->floatCells[0]);
+      free(sharedData->floatCells[1]);
+      // every thread of the double steps starts with sense 0, the barrier
+      // must too, whatever the parity of the float episodes
+      initBarrier(&sharedData->barrier, sharedData->threadCount);
+    }
+    // snapshots are only taken from the double precision steps
+    Checkpointer checkpointer;
+    sharedData->checkpointer = NULL;
+    if (args.checkpointIterations > 0 || args.checkpointSeconds > 0) {
+      startCheckpointer(&checkpointer, &jobData, sharedData->readPlate,
+        sharedData->totalIterations, &args);
+      sharedData->checkpointer = &checkpointer;
+    }
+    runParallel(pool, sharedData->threadCount, routine, sharedData);
+    if (sharedData->checkpointer != NULL) {
+      stopCheckpointer(&checkpointer);
+    }
 
-    join_threads(sharedData->threadCount, team);
-    pthread_mutex_destroy(&sharedData->can_accsess_isBalanced);
-    pthread_mutex_destroy(&sharedData->barrierMutex);
-    pthread_mutex_destroy(&sharedData->can_accsess_currentCell);
-    sem_destroy(&sharedData->turnstile1);
-    sem_destroy(&sharedData->turnstile2);
+    destroyWorkQueue(&sharedData->workQueue);
 
+  // the last state is always in the write plate, which may be any of the two
   SimulationResult result;
-  result.plate = writePlate;
+  result.plate = sharedData->writePlate;
   result.iterations = sharedData->totalIterations + 1;
 
   // free memory
-  destroyPlate(readPlate);
+  destroyPlate(sharedData->readPlate);
+  free(sharedData->stepDeltas);
+  free(sharedData->changedTiles[0]);
+  free(sharedData->changedTiles[1]);
   free(sharedData);
   return result;
 }
 
+// Updates a tile, or skips it if active-tile tracking finds it steady
+static double processTile(SharedData* sharedData, size_t tileIndex,
+  double factor, StencilRowFunction updateRow) {
+    const Plate* readPlate = sharedData->readPlate;
+    const TilePlan* tilePlan = &sharedData->tilePlan;
+    unsigned char* changedTiles = NULL;
+    if (sharedData->changedTiles[0] != NULL) {
+        // flags of this step and of the previous one alternate
+        const size_t step = sharedData->totalIterations % 2;
+        changedTiles = sharedData->changedTiles[step];
+        if (!isTileActive(tilePlan, sharedData->changedTiles[!step],
+          tileIndex)) {
+            // the write plate already holds the same cells
+            changedTiles[tileIndex] = 0;
+            return 0.0;
+        }
+    }
+
+    double tileDelta = updateTile(readPlate, sharedData->writePlate,
+      getTile(tilePlan, readPlate->rows, readPlate->cols, tileIndex), factor,
+      updateRow);
+    if (changedTiles != NULL) {
+        changedTiles[tileIndex] = tileDelta != 0.0;
+    }
+    return tileDelta;
+}
+
 void* calcNewTemperature(void* data) {
     const struct private_data* privateData = (struct private_data*)data;
     SharedData* sharedData = (SharedData*) privateData->data;
 
-    const size_t threadCount = privateData->thread_count;
-
     const JobData jobData = sharedData->jobData;
     const double factor = (jobData.duration * jobData.thermalDiffusivity) /
                     (jobData.plateCellDimmensions *
                     jobData.plateCellDimmensions);
-    const size_t rows = sharedData->readPlate->rows;
-    const size_t cols = sharedData->readPlate->cols;
-
-    // Ajuste para manejar divisiones no exactas
-    size_t rowsPerThread = rows / threadCount;
-    // Filas extra a distribuir entre los primeros hilos
-    size_t extraRows = rows % threadCount;
-
-    size_t startRow, endRow;
-
-    if (privateData->thread_number < extraRows) {
-        // Los primeros 'extraRows' hilos procesan una fila extra
-        startRow = privateData->thread_number * (rowsPerThread + 1);
-        endRow = startRow + rowsPerThread + 1;
-    } else {
-        // Los hilos restantes procesan solo 'rowsPerThread' filas
-        startRow = privateData->thread_number * rowsPerThread + extraRows;
-        endRow = startRow + rowsPerThread;
-    }
-
-    while (1) {
-        double** currentPlateData = sharedData->readPlate->data;
-        double** newPlateData = sharedData->writePlate->data;
-        int localIsBalanced = 1;
 
-        if (sharedData->writePlate->isBalanced == 2) {
-            break;
-        }
+    #ifdef CYCLIC_MAPPING
+    const TilePlan* tilePlan = &sharedData->tilePlan;
+    const size_t threadCount = privateData->thread_count;
+    // cada hilo procesa un rango contiguo de bloques de la placa
+    const size_t firstTile = privateData->thread_number
+      * tilePlan->tilesCount / threadCount;
+    const size_t lastTile = (privateData->thread_number + 1)
+      * tilePlan->tilesCount / threadCount;
+    #endif
+
+    const StencilRowFunction updateRow = sharedData->stencilKernel.updateRow;
+
+    int sense = 0;
+    int isBalanced = 0;
+    while (!isBalanced) {
+        double maxDelta = 0.0;
+        // the band of a due snapshot, the read plate does not change now
+        copyCheckpointRows(sharedData->checkpointer,
+          privateData->thread_number, privateData->thread_count);
 
         // --------------------------
         #ifdef CYCLIC_MAPPING
       printf("Iteration %zu\n", sharedData->totalIterations);
 
-        // Procesar las celdas en el rango de filas asignadas al hilo
-        for (size_t row = startRow; row < endRow; ++row) {
-            for (size_t col = 1; col < cols - 1; ++col) {
-                if (row > 0 && row < rows - 1) {
-                    double left = currentPlateData[row][col - 1];
-                    double right = currentPlateData[row][col + 1];
-                    double up = currentPlateData[row - 1][col];
-                    double down = currentPlateData[row + 1][col];
-                    double cell = currentPlateData[row][col];
-
-                    double newTemperature = cell + factor *
-                    (left + right  + up + down - 4 * cell);
-                      newPlateData[row][col] = newTemperature;
-
-                    if (fabs(newTemperature - cell) > jobData.balancePoint) {
-                        localIsBalanced = 0;  // No está balanceado
-                    }
-                }
-            }
+        // Procesar los bloques asignados al hilo
+        for (size_t index = firstTile; index < lastTile; ++index) {
+            double tileDelta = processTile(sharedData, index, factor,
+              updateRow);
+            maxDelta = tileDelta > maxDelta ? tileDelta : maxDelta;
         }
         // ---------------------------------------
         #else
-          // dynamic mapping
-        size_t totalCells = rows * cols;
-        size_t currentCell;
-        while (1) {
-            pthread_mutex_lock(&sharedData->can_accsess_currentCell);
-            currentCell = sharedData->currentCell;
-            sharedData->currentCell++;
-            pthread_mutex_unlock(&sharedData->can_accsess_currentCell);
-            if (currentCell >= totalCells) {
-                break;
+          // dynamic mapping: chunks of blocks claimed with one atomic each
+        size_t firstTile, lastTile;
+        while (claimWork(&sharedData->workQueue, privateData->thread_number,
+          &firstTile, &lastTile)) {
+            for (size_t index = firstTile; index < lastTile; ++index) {
+                double tileDelta = processTile(sharedData, index, factor,
+                  updateRow);
+                maxDelta = tileDelta > maxDelta ? tileDelta : maxDelta;
             }
+        }
+        #endif
+        const int localIsBalanced = maxDelta <= jobData.balancePoint;
+        // Esperar a que todos los hilos terminen, la barrera reduce el
+        // balance de todos los hilos
+        isBalanced = waitBarrier(&sharedData->barrier, &sense,
+          localIsBalanced, finishIteration, sharedData);
+    }
 
-            size_t row = currentCell / cols;
-            size_t col = currentCell % cols;
+    return NULL;
+}
 
-            if (row > 0 && row < (rows - 1) && col > 0 && col < cols - 1) {
-                double left = currentPlateData[row][col - 1];
-                double right = currentPlateData[row][col + 1];
-                double up = currentPlateData[row - 1][col];
-                double down = currentPlateData[row + 1][col];
-                double cell = currentPlateData[row][col];
+int finishIteration(void* data, int isBalanced) {
+    SharedData* sharedData = (SharedData*) data;
+    isBalanced = isBalanced
+      && sharedData->totalIterations >= FIRST_BALANCE_STEP;
+    if (isBalanced) {
+      sharedData->writePlate->isBalanced = 1;
+    } else {
+      // swap plates
+      Plate* temp = sharedData->readPlate;
+      sharedData->readPlate = sharedData->writePlate;
+      sharedData->writePlate = temp;
+      sharedData->totalIterations++;
+      resetWorkQueue(&sharedData->workQueue);
+      if (sharedData->checkpointer != NULL) {
+        offerCheckpoint(sharedData->checkpointer, sharedData->readPlate,
+          sharedData->totalIterations);
+      }
+    }
+    return isBalanced;
+}
 
-                double newTemperature = cell + factor * (left
-                + right + up + down - 4 * cell);
-                newPlateData[row][col] = newTemperature;
+void* calcNewTemperatureFloat(void* data) {
+    const struct private_data* privateData = (struct private_data*)data;
+    SharedData* sharedData = (SharedData*) privateData->data;
 
-                if (fabs(newTemperature - cell) > jobData.balancePoint) {
-                    localIsBalanced = 0;  // No está balanceado
-                }
-            }
-        }
-        #endif
-        pthread_mutex_lock(&sharedData->can_accsess_isBalanced);
-        sharedData->writePlate->isBalanced =
-          sharedData->writePlate->isBalanced && localIsBalanced;
-        pthread_mutex_unlock(&sharedData->can_accsess_isBalanced);
-
-        // Esperar a que todos los hilos terminen
-        pthread_mutex_lock(&sharedData->barrierMutex);
-        if (++sharedData->barrierCount == sharedData->threadCount) {
-            sem_wait(&sharedData->turnstile2);
-            sem_post(&sharedData->turnstile1);
-            pthread_mutex_lock(&sharedData->can_accsess_isBalanced);
-            if (sharedData->writePlate->isBalanced) {
-              sharedData->writePlate->isBalanced = 2;
-            } else {
-              sharedData->writePlate->isBalanced = 1;
-              // swap plates
-              Plate* temp = sharedData->readPlate;
-              sharedData->readPlate = sharedData->writePlate;
-              sharedData->writePlate = temp;
-              sharedData->totalIterations++;
-              sharedData->currentCell = 0;
+    const JobData jobData = sharedData->jobData;
+    const float factor = (jobData.duration * jobData.thermalDiffusivity) /
+                    (jobData.plateCellDimmensions *
+                    jobData.plateCellDimmensions);
+    const size_t rows = sharedData->readPlate->rows;
+    const size_t cols = sharedData->readPlate->cols;
+    const size_t stride = sharedData->readPlate->stride;
+    const StencilRowFunctionFloat updateRow =
+      sharedData->stencilKernel.updateRowFloat;
+
+    // each thread owns a contiguous range of tiles
+    const TilePlan* tilePlan = &sharedData->tilePlan;
+    const size_t firstTile = privateData->thread_number
+      * tilePlan->tilesCount / privateData->thread_count;
+    const size_t lastTile = (privateData->thread_number + 1)
+      * tilePlan->tilesCount / privateData->thread_count;
+
+    int sense = 0;
+    int isNearBalance = 0;
+    while (!isNearBalance) {
+        const float* current = sharedData->floatCells[0];
+        float* next = sharedData->floatCells[1];
+        float maxDelta = 0.0f;
+        for (size_t index = firstTile; index < lastTile; ++index) {
+            const Tile tile = getTile(tilePlan, rows, cols, index);
+            for (size_t row = tile.startRow; row < tile.endRow; ++row) {
+                float rowDelta = updateRow(current + row * stride,
+                  next + row * stride, stride, tile.startCol, tile.endCol,
+                  factor);
+                maxDelta = rowDelta > maxDelta ? rowDelta : maxDelta;
             }
-            pthread_mutex_unlock(&sharedData->can_accsess_isBalanced);
-        }
-        pthread_mutex_unlock(&sharedData->barrierMutex);
-        // Esperar a que todos los hilos lleguen
-        sem_wait(&sharedData->turnstile1);
-        sem_post(&sharedData->turnstile1);  // Despertar a los demás hilos
-
-        pthread_mutex_lock(&sharedData->barrierMutex);
-        if (--sharedData->barrierCount == 0) {
-            sem_wait(&sharedData->turnstile1);
-            sem_post(&sharedData->turnstile2);
         }
-        pthread_mutex_unlock(&sharedData->barrierMutex);
+        isNearBalance = waitBarrier(&sharedData->barrier, &sense,
+          maxDelta <= sharedData->floatThreshold, finishFloatIteration,
+          sharedData);
+    }
+    return NULL;
+}
 
-        sem_wait(&sharedData->turnstile2);
-        sem_post(&sharedData->turnstile2);
+int finishFloatIteration(void* data, int isNearBalance) {
+    SharedData* sharedData = (SharedData*) data;
+    if (!isNearBalance) {
+      float* temp = sharedData->floatCells[0];
+      sharedData->floatCells[0] = sharedData->floatCells[1];
+      sharedData->floatCells[1] = temp;
+      sharedData->totalIterations++;
     }
+    return isNearBalance;
+}
+
+void* calcNewTemperatureBlocked(void* data) {
+    const struct private_data* privateData = (struct private_data*)data;
+    SharedData* sharedData = (SharedData*) privateData->data;
 
+    const JobData jobData = sharedData->jobData;
+    const double factor = (jobData.duration * jobData.thermalDiffusivity) /
+                    (jobData.plateCellDimmensions *
+                    jobData.plateCellDimmensions);
+    const size_t rows = sharedData->readPlate->rows;
+    const size_t cols = sharedData->readPlate->cols;
+    const TimeBlocking* blocking = &sharedData->timeBlocking;
+    const StencilRowFunction updateRow = sharedData->stencilKernel.updateRow;
+
+    // each thread owns a contiguous range of tiles
+    const size_t threadNumber = privateData->thread_number;
+    const size_t threadCount = privateData->thread_count;
+    const size_t firstTile = threadNumber * blocking->tiles.tilesCount
+      / threadCount;
+    const size_t lastTile = (threadNumber + 1) * blocking->tiles.tilesCount
+      / threadCount;
+    double* stepDeltas = sharedData->stepDeltas
+      + threadNumber * blocking->steps;
+
+    double* scratch[2] = {NULL, NULL};
+    if (lastTile > firstTile) {
+      scratch[0] = aligned_alloc(PLATE_ALIGNMENT,
+        blocking->scratchSize * sizeof(double));
+      scratch[1] = aligned_alloc(PLATE_ALIGNMENT,
+        blocking->scratchSize * sizeof(double));
+      assert(scratch[0] != NULL && scratch[1] != NULL);
+    }
+
+    int sense = 0;
+    int isBalanced = 0;
+    while (!isBalanced) {
+        const size_t steps = sharedData->blockSteps;
+        copyCheckpointRows(sharedData->checkpointer, threadNumber,
+          threadCount);
+        for (size_t tile = firstTile; tile < lastTile; ++tile) {
+            advanceTile(sharedData->readPlate, sharedData->writePlate,
+              getTile(&blocking->tiles, rows, cols, tile), steps, factor,
+              updateRow, scratch, stepDeltas);
+        }
+        // the convergence of every step is in stepDeltas, nothing to reduce
+        isBalanced = waitBarrier(&sharedData->barrier, &sense, 1,
+          finishTimeBlock, sharedData);
+    }
+
+    free(scratch[0]);
+    free(scratch[1]);
     return NULL;
 }
 
+int finishTimeBlock(void* data, int isReduced) {
+    (void) isReduced;
+    SharedData* sharedData = (SharedData*) data;
+    const size_t steps = sharedData->blockSteps;
+    if (sharedData->isFinishing) {
+      // the pass stopped exactly at the balance step
+      sharedData->writePlate->isBalanced = 1;
+      sharedData->totalIterations += steps - 1;
+      return 1;
+    }
+
+    // first step of the pass where every cell changed less than epsilon
+    size_t balancedStep = 0;
+    for (size_t step = 0; step < steps && balancedStep == 0; ++step) {
+      double maxDelta = 0.0;
+      for (size_t thread = 0; thread < sharedData->threadCount; ++thread) {
+        double delta = sharedData->stepDeltas[thread
+          * sharedData->timeBlocking.steps + step];
+        maxDelta = delta > maxDelta ? delta : maxDelta;
+      }
+      if (maxDelta <= sharedData->jobData.balancePoint
+        && sharedData->totalIterations + step >= FIRST_BALANCE_STEP) {
+        balancedStep = step + 1;
+      }
+    }
+    memset(sharedData->stepDeltas, 0, sharedData->threadCount
+      * sharedData->timeBlocking.steps * sizeof(double));
+
+    if (balancedStep == 0) {
+      // swap plates
+      Plate* temp = sharedData->readPlate;
+      sharedData->readPlate = sharedData->writePlate;
+      sharedData->writePlate = temp;
+      sharedData->totalIterations += steps;
+      if (sharedData->checkpointer != NULL) {
+        offerCheckpoint(sharedData->checkpointer, sharedData->readPlate,
+          sharedData->totalIterations);
+      }
+    } else if (balancedStep == steps) {
+      sharedData->writePlate->isBalanced = 1;
+      sharedData->totalIterations += steps - 1;
+      return 1;
+    } else {
+      // the write plate went past the balance, redo a shorter pass from the
+      // same read plate
+      sharedData->blockSteps = balancedStep;
+      sharedData->isFinishing = 1;
+    }
+    return 0;
+}
 
 Plate* copyPlate(Plate* plate) {
-  Plate* newPlate = malloc(sizeof(Plate));
-  newPlate->rows = plate->rows;
-  newPlate->cols = plate->cols;
+  Plate* newPlate = createPlateStrided(plate->rows, plate->cols,
+    plate->stride);
   newPlate->isBalanced = plate->isBalanced;
-  newPlate->data = malloc(newPlate->rows * sizeof(double*));
-  for (size_t i = 0; i < newPlate->rows; i++) {
-    newPlate->data[i] = malloc(newPlate->cols * sizeof(double));
-    memcpy(newPlate->data[i], plate->data[i], newPlate->cols * sizeof(double));
-  }
+  memcpy(newPlate->data, plate->data,
+    plate->rows * plate->stride * sizeof(double));
   return newPlate;
 }
 
 void copyPlateBorders(Plate original, Plate copy) {
   // top
-  for (size_t colIndex = 0; colIndex < original.cols; colIndex++) {
-    copy.data[0][colIndex] = original.data[0][colIndex];
-  }
+  memcpy(PLATE_ROW(&copy, 0), PLATE_ROW(&original, 0),
+    original.cols * sizeof(double));
 
   // left
   for (size_t rowIndex = 0; rowIndex < original.rows; rowIndex++) {
-    copy.data[rowIndex][0] = original.data[rowIndex][0];
+    PLATE_ROW(&copy, rowIndex)[0] = PLATE_ROW(&original, rowIndex)[0];
   }
 
   // right
   for (size_t rowIndex = 0; rowIndex < original.rows; rowIndex++) {
-    copy.data[rowIndex][original.cols - 1]
-      = original.data[rowIndex][original.cols - 1];
+    PLATE_ROW(&copy, rowIndex)[original.cols - 1]
+      = PLATE_ROW(&original, rowIndex)[original.cols - 1];
   }
 
   // bottom
-  for (size_t colIndex = 0; colIndex < original.cols; colIndex++) {
-    copy.data[original.rows - 1][colIndex]
-      = original.data[original.rows - 1][colIndex];
-  }
+  memcpy(PLATE_ROW(&copy, original.rows - 1),
+    PLATE_ROW(&original, original.rows - 1), original.cols * sizeof(double));
 }
 
 
@@ -292,25 +533,25 @@ void format_time(time_t seconds, char *buffer, size_t buffer_size) {
       months, days, hours, minutes, secs);
 }
 
-void destroyJobsData(JobData *jobsData, size_t jobsCount) {
-    for (size_t i = 0; i < jobsCount; i++) {
-        free(jobsData[i].plateFile);
-        free(jobsData[i].directory);
-    }
+void destroyJobsData(JobData *jobsData) {
+    // the strings of the jobs are in the same block
     free(jobsData);
 }
 
 void destroyPlate(Plate* plate) {
-  for (size_t i = 0; i < plate->rows; i++) {
-    free(plate->data[i]);
+  if (plate->mappedSize > 0) {
+    munmap((char*) plate->data - PLATE_HEADER_SIZE, plate->mappedSize);
+  } else {
+    free(plate->data);
   }
-  free(plate->data);
   free(plate);
 }
 
 void destroySimulationResult(SimulationResult* results, size_t resultsCount) {
     for (size_t i = 0; i < resultsCount; i++) {
-        destroyPlate(results[i].plate);
+        if (results[i].plate != NULL) {
+            destroyPlate(results[i].plate);
+        }
     }
     free(results);
 }
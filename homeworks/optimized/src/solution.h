@@ -3,8 +3,19 @@
 #pragma once
 #include <stdio.h>
 #include <stdlib.h>
+#include "pool.h"
 #include "types.h"
 
+/// Mixed precision switches to double below this many times epsilon
+#define MIXED_SWITCH_FACTOR 4
+
+/// Float ulps of the hottest cell below which float changes are noise
+#define MIXED_NOISE_ULPS 64
+
+/// First step (0 based) that may end a job, each plate's balance flag starts
+/// cleared and must be written once, so writeJobResult never reports k < 3
+#define FIRST_BALANCE_STEP 2
+
 /**
  * @brief Processes a job using the provided job data.
  *
@@ -13,19 +24,26 @@
  *
  * @param jobData The job data to be processed.
  * @param args The arguments for the simulation.
+ * @param pool The workers that run the simulation.
  * @return The result of the job processing.
  */
-SimulationResult processJob(JobData jobData, Arguments args);
+SimulationResult processJob(JobData jobData, Arguments args,
+    ThreadPool* pool);
 
 /**
  * Simulates the given job data on the specified plate.
  *
  * @param jobData The job data to be simulated.
- * @param plate The plate on which the simulation will be performed.
+ * @param plate The plate on which the simulation will be performed, copied
+ * to padded plates and freed by the simulation.
+ * @param firstIteration The iterations already done on the plate, 0 unless
+ * the plate comes from a checkpoint.
  * @param args The arguments for the simulation.
+ * @param pool The workers that run the simulation.
  * @return The result of the simulation.
  */
-SimulationResult simulate(JobData jobData, Plate* plate, Arguments args);
+SimulationResult simulate(JobData jobData, Plate* plate,
+    size_t firstIteration, Arguments args, ThreadPool* pool);
 
 /**
  * @brief Creates a copy of a Plate object.
@@ -69,19 +87,75 @@ void simulationIteration(JobData jobData, Plate* readPlate, Plate* writePlate,
  */
 void* calcNewTemperature(void* data);
 
+/**
+ * @brief Updates the plates after every thread finished an iteration.
+ *
+ * Run by the last thread that reaches the barrier. Marks the write plate as
+ * balanced or swaps the plates for the next iteration.
+ *
+ * @param data The data shared by the thread team.
+ * @param isBalanced Whether every thread found its cells balanced.
+ * @return isBalanced, so the threads stop once the plate is balanced.
+ */
+int finishIteration(void* data, int isBalanced);
+
+/**
+ * Advances the plate several time steps per pass over cache-sized tiles.
+ *
+ * Temporal blocking version of calcNewTemperature. Convergence is still
+ * checked per step, so the iteration count is the same.
+ *
+ * @param data The private data of the thread.
+ * @return NULL.
+ */
+void* calcNewTemperatureBlocked(void* data);
+
+/**
+ * Advances the plate in single precision until it nears the balance.
+ *
+ * Runs the steps whose biggest change is above floatThreshold on the float
+ * plates, so the double engine takes over a few steps before the balance
+ * and decides the iteration count.
+ *
+ * @param data The private data of the thread.
+ * @return NULL.
+ */
+void* calcNewTemperatureFloat(void* data);
+
+/**
+ * @brief Swaps the float plates after every thread finished a step.
+ *
+ * Run by the last thread that reaches the barrier. A step with every change
+ * below floatThreshold is discarded, the double engine repeats it.
+ *
+ * @param data The data shared by the thread team.
+ * @param isNearBalance Whether every change was below floatThreshold.
+ * @return isNearBalance, so the threads stop the float steps.
+ */
+int finishFloatIteration(void* data, int isNearBalance);
+
+/**
+ * @brief Updates the plates after every thread finished a tile pass.
+ *
+ * Run by the last thread that reaches the barrier. Finds the first step of
+ * the pass that balanced the plate. If it is not the last one of the pass,
+ * the pass is repeated from the same read plate up to that step.
+ *
+ * @param data The data shared by the thread team.
+ * @param isReduced Unused, the deltas of every step are in stepDeltas.
+ * @return 1 once the plate is balanced, 0 for another pass.
+ */
+int finishTimeBlock(void* data, int isReduced);
 
 /**
  * @brief Destroys the JobData array and frees the memory.
  *
  * This function is responsible for deallocating the memory used by the JobData array.
- * It takes a pointer to the JobData array and the number of jobs as parameters.
- * The function frees the memory allocated for each JobData element and then frees the memory
- * allocated for the JobData array itself.
+ * The array and the strings of its jobs are a single block.
  *
- * @param jobsData Pointer to the JobData array.
- * @param jobsCount Number of jobs in the array.
+ * @param jobsData Pointer to the JobData array, as returned by readJobData.
  */
-void destroyJobsData(JobData *jobsData, size_t jobsCount);
+void destroyJobsData(JobData *jobsData);
 /**
  * @brief Destroys a Plate object.
  *
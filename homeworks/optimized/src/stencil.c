@@ -0,0 +1,266 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#include "stencil.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define STENCIL_X86
+#include <immintrin.h>
+#endif
+
+static inline double maxOf(double first, double second) {
+  return first > second ? first : second;
+}
+
+// All kernels evaluate the formula in the same order as the scalar one, so
+// every kernel produces bit-identical plates.
+
+static double updateRowScalar(const double* current, double* next,
+  size_t stride, size_t startCol, size_t endCol, double factor) {
+  const double* above = current - stride;
+  const double* below = current + stride;
+  double maxDelta = 0.0;
+  for (size_t col = startCol; col < endCol; ++col) {
+    double cell = current[col];
+    double newTemperature = cell + factor * (current[col - 1]
+      + current[col + 1] + above[col] + below[col] - 4 * cell);
+    next[col] = newTemperature;
+    // no branch, the convergence test is just a running maximum
+    double delta = fabs(newTemperature - cell);
+    maxDelta = maxOf(maxDelta, delta);
+  }
+  return maxDelta;
+}
+
+static float updateRowScalarFloat(const float* current, float* next,
+  size_t stride, size_t startCol, size_t endCol, float factor) {
+  const float* above = current - stride;
+  const float* below = current + stride;
+  float maxDelta = 0.0f;
+  for (size_t col = startCol; col < endCol; ++col) {
+    float cell = current[col];
+    float newTemperature = cell + factor * (current[col - 1]
+      + current[col + 1] + above[col] + below[col] - 4 * cell);
+    next[col] = newTemperature;
+    float delta = fabsf(newTemperature - cell);
+    maxDelta = delta > maxDelta ? delta : maxDelta;
+  }
+  return maxDelta;
+}
+
+#ifdef STENCIL_X86
+__attribute__((target("sse2")))
+static double updateRowSse2(const double* current, double* next,
+  size_t stride, size_t startCol, size_t endCol, double factor) {
+  const double* above = current - stride;
+  const double* below = current + stride;
+  const __m128d factors = _mm_set1_pd(factor);
+  const __m128d fours = _mm_set1_pd(4.0);
+  const __m128d signBits = _mm_set1_pd(-0.0);
+  __m128d maxDeltas = _mm_setzero_pd();
+  size_t col = startCol;
+  for (; col + 2 <= endCol; col += 2) {
+    __m128d cell = _mm_loadu_pd(current + col);
+    __m128d sum = _mm_add_pd(_mm_add_pd(_mm_add_pd(
+      _mm_loadu_pd(current + col - 1), _mm_loadu_pd(current + col + 1)),
+      _mm_loadu_pd(above + col)), _mm_loadu_pd(below + col));
+    __m128d newTemperature = _mm_add_pd(cell, _mm_mul_pd(factors,
+      _mm_sub_pd(sum, _mm_mul_pd(fours, cell))));
+    _mm_storeu_pd(next + col, newTemperature);
+    maxDeltas = _mm_max_pd(maxDeltas,
+      _mm_andnot_pd(signBits, _mm_sub_pd(newTemperature, cell)));
+  }
+  double lanes[2];
+  _mm_storeu_pd(lanes, maxDeltas);
+  double maxDelta = maxOf(lanes[0], lanes[1]);
+  return maxOf(maxDelta, updateRowScalar(current, next, stride, col, endCol,
+    factor));
+}
+
+__attribute__((target("avx2")))
+static double updateRowAvx2(const double* current, double* next,
+  size_t stride, size_t startCol, size_t endCol, double factor) {
+  const double* above = current - stride;
+  const double* below = current + stride;
+  const __m256d factors = _mm256_set1_pd(factor);
+  const __m256d fours = _mm256_set1_pd(4.0);
+  const __m256d signBits = _mm256_set1_pd(-0.0);
+  __m256d maxDeltas = _mm256_setzero_pd();
+  size_t col = startCol;
+  for (; col + 4 <= endCol; col += 4) {
+    __m256d cell = _mm256_loadu_pd(current + col);
+    __m256d sum = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(
+      _mm256_loadu_pd(current + col - 1), _mm256_loadu_pd(current + col + 1)),
+      _mm256_loadu_pd(above + col)), _mm256_loadu_pd(below + col));
+    __m256d newTemperature = _mm256_add_pd(cell, _mm256_mul_pd(factors,
+      _mm256_sub_pd(sum, _mm256_mul_pd(fours, cell))));
+    _mm256_storeu_pd(next + col, newTemperature);
+    maxDeltas = _mm256_max_pd(maxDeltas,
+      _mm256_andnot_pd(signBits, _mm256_sub_pd(newTemperature, cell)));
+  }
+  double lanes[4];
+  _mm256_storeu_pd(lanes, maxDeltas);
+  double maxDelta = maxOf(maxOf(lanes[0], lanes[1]),
+    maxOf(lanes[2], lanes[3]));
+  return maxOf(maxDelta, updateRowScalar(current, next, stride, col, endCol,
+    factor));
+}
+
+__attribute__((target("avx512f")))
+static double updateRowAvx512(const double* current, double* next,
+  size_t stride, size_t startCol, size_t endCol, double factor) {
+  const double* above = current - stride;
+  const double* below = current + stride;
+  const __m512d factors = _mm512_set1_pd(factor);
+  const __m512d fours = _mm512_set1_pd(4.0);
+  __m512d maxDeltas = _mm512_setzero_pd();
+  size_t col = startCol;
+  for (; col + 8 <= endCol; col += 8) {
+    __m512d cell = _mm512_loadu_pd(current + col);
+    __m512d sum = _mm512_add_pd(_mm512_add_pd(_mm512_add_pd(
+      _mm512_loadu_pd(current + col - 1), _mm512_loadu_pd(current + col + 1)),
+      _mm512_loadu_pd(above + col)), _mm512_loadu_pd(below + col));
+    __m512d newTemperature = _mm512_add_pd(cell, _mm512_mul_pd(factors,
+      _mm512_sub_pd(sum, _mm512_mul_pd(fours, cell))));
+    _mm512_storeu_pd(next + col, newTemperature);
+    maxDeltas = _mm512_max_pd(maxDeltas,
+      _mm512_abs_pd(_mm512_sub_pd(newTemperature, cell)));
+  }
+  double maxDelta = _mm512_reduce_max_pd(maxDeltas);
+  return maxOf(maxDelta, updateRowScalar(current, next, stride, col, endCol,
+    factor));
+}
+
+// Single precision kernels process twice the cells per instruction
+
+__attribute__((target("sse2")))
+static float updateRowSse2Float(const float* current, float* next,
+  size_t stride, size_t startCol, size_t endCol, float factor) {
+  const float* above = current - stride;
+  const float* below = current + stride;
+  const __m128 factors = _mm_set1_ps(factor);
+  const __m128 fours = _mm_set1_ps(4.0f);
+  const __m128 signBits = _mm_set1_ps(-0.0f);
+  __m128 maxDeltas = _mm_setzero_ps();
+  size_t col = startCol;
+  for (; col + 4 <= endCol; col += 4) {
+    __m128 cell = _mm_loadu_ps(current + col);
+    __m128 sum = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+      _mm_loadu_ps(current + col - 1), _mm_loadu_ps(current + col + 1)),
+      _mm_loadu_ps(above + col)), _mm_loadu_ps(below + col));
+    __m128 newTemperature = _mm_add_ps(cell, _mm_mul_ps(factors,
+      _mm_sub_ps(sum, _mm_mul_ps(fours, cell))));
+    _mm_storeu_ps(next + col, newTemperature);
+    maxDeltas = _mm_max_ps(maxDeltas,
+      _mm_andnot_ps(signBits, _mm_sub_ps(newTemperature, cell)));
+  }
+  float lanes[4];
+  _mm_storeu_ps(lanes, maxDeltas);
+  float maxDelta = lanes[0];
+  for (size_t lane = 1; lane < 4; ++lane) {
+    maxDelta = lanes[lane] > maxDelta ? lanes[lane] : maxDelta;
+  }
+  float tailDelta = updateRowScalarFloat(current, next, stride, col, endCol,
+    factor);
+  return tailDelta > maxDelta ? tailDelta : maxDelta;
+}
+
+__attribute__((target("avx2")))
+static float updateRowAvx2Float(const float* current, float* next,
+  size_t stride, size_t startCol, size_t endCol, float factor) {
+  const float* above = current - stride;
+  const float* below = current + stride;
+  const __m256 factors = _mm256_set1_ps(factor);
+  const __m256 fours = _mm256_set1_ps(4.0f);
+  const __m256 signBits = _mm256_set1_ps(-0.0f);
+  __m256 maxDeltas = _mm256_setzero_ps();
+  size_t col = startCol;
+  for (; col + 8 <= endCol; col += 8) {
+    __m256 cell = _mm256_loadu_ps(current + col);
+    __m256 sum = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+      _mm256_loadu_ps(current + col - 1), _mm256_loadu_ps(current + col + 1)),
+      _mm256_loadu_ps(above + col)), _mm256_loadu_ps(below + col));
+    __m256 newTemperature = _mm256_add_ps(cell, _mm256_mul_ps(factors,
+      _mm256_sub_ps(sum, _mm256_mul_ps(fours, cell))));
+    _mm256_storeu_ps(next + col, newTemperature);
+    maxDeltas = _mm256_max_ps(maxDeltas,
+      _mm256_andnot_ps(signBits, _mm256_sub_ps(newTemperature, cell)));
+  }
+  float lanes[8];
+  _mm256_storeu_ps(lanes, maxDeltas);
+  float maxDelta = lanes[0];
+  for (size_t lane = 1; lane < 8; ++lane) {
+    maxDelta = lanes[lane] > maxDelta ? lanes[lane] : maxDelta;
+  }
+  float tailDelta = updateRowScalarFloat(current, next, stride, col, endCol,
+    factor);
+  return tailDelta > maxDelta ? tailDelta : maxDelta;
+}
+
+__attribute__((target("avx512f")))
+static float updateRowAvx512Float(const float* current, float* next,
+  size_t stride, size_t startCol, size_t endCol, float factor) {
+  const float* above = current - stride;
+  const float* below = current + stride;
+  const __m512 factors = _mm512_set1_ps(factor);
+  const __m512 fours = _mm512_set1_ps(4.0f);
+  __m512 maxDeltas = _mm512_setzero_ps();
+  size_t col = startCol;
+  for (; col + 16 <= endCol; col += 16) {
+    __m512 cell = _mm512_loadu_ps(current + col);
+    __m512 sum = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(
+      _mm512_loadu_ps(current + col - 1), _mm512_loadu_ps(current + col + 1)),
+      _mm512_loadu_ps(above + col)), _mm512_loadu_ps(below + col));
+    __m512 newTemperature = _mm512_add_ps(cell, _mm512_mul_ps(factors,
+      _mm512_sub_ps(sum, _mm512_mul_ps(fours, cell))));
+    _mm512_storeu_ps(next + col, newTemperature);
+    maxDeltas = _mm512_max_ps(maxDeltas,
+      _mm512_abs_ps(_mm512_sub_ps(newTemperature, cell)));
+  }
+  float maxDelta = _mm512_reduce_max_ps(maxDeltas);
+  float tailDelta = updateRowScalarFloat(current, next, stride, col, endCol,
+    factor);
+  return tailDelta > maxDelta ? tailDelta : maxDelta;
+}
+#endif
+
+StencilKernel findStencilKernel(const char* name) {
+  // from the widest to the narrowest instruction set
+  StencilKernel kernels[] = {
+#ifdef STENCIL_X86
+    {"avx512", updateRowAvx512, updateRowAvx512Float},
+    {"avx2", updateRowAvx2, updateRowAvx2Float},
+    {"sse2", updateRowSse2, updateRowSse2Float},
+#endif
+    {"scalar", updateRowScalar, updateRowScalarFloat},
+  };
+  const size_t kernelsCount = sizeof(kernels) / sizeof(kernels[0]);
+
+#ifdef STENCIL_X86
+  __builtin_cpu_init();
+  const int supported[] = {
+    __builtin_cpu_supports("avx512f"),
+    __builtin_cpu_supports("avx2"),
+    __builtin_cpu_supports("sse2"),
+    1
+  };
+#else
+  const int supported[] = {1};
+#endif
+
+  for (size_t index = 0; index < kernelsCount; ++index) {
+    if (name == NULL && supported[index]) {
+      return kernels[index];
+    }
+    if (name != NULL && strcmp(name, kernels[index].name) == 0) {
+      if (!supported[index]) {
+        kernels[index].updateRow = NULL;
+        kernels[index].updateRowFloat = NULL;
+      }
+      return kernels[index];
+    }
+  }
+
+  StencilKernel unknown = {name, NULL, NULL};
+  return unknown;
+}
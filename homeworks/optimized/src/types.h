@@ -1,19 +1,33 @@
 // Copyright <2024> <Aaron Santana Valdelomar - UCR>
 #pragma once
-#include <semaphore.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include "barrier.h"
+#include "schedule.h"
+#include "stencil.h"
+
+struct Checkpointer;
 
 /**
  * @brief Structure representing a plate with data, number of rows, and number of columns.
+ *
+ * Cell (row, col) is stored at data[row * stride + col]. Allocated plates
+ * keep their cells in one 64-byte aligned buffer with padded rows. A plate
+ * loaded with mmap points into the read-only file mapping, right after the
+ * header, so it is only 8-byte aligned and its stride is cols; the
+ * simulation only copies it to allocated plates.
  */
 
 typedef struct  {
-    double** data;  /// < matrix of doubles representing the plate
+    double* data;  /// < row-major cells, 64-byte aligned unless mapped
+        /// from a file
     short isBalanced;  /// < indicates if the plate is balanced
     size_t rows;  /// < number of rows in the plate
     size_t cols;  /// < number of columns in the plate
+    size_t stride;  /// < row length in doubles, padded unless mapped
+        /// from a file, where it equals cols
+    size_t mappedSize;  /// < bytes of the mapped file, 0 if data is allocated
 } Plate;
 
 /**
@@ -29,6 +43,22 @@ typedef struct {
     short shloudPrintIterations;  /// < indicates if the program
         /// should print the
         /// number of iterations counted in the simulation
+    size_t prefetchCount;  /// < plates read ahead of the running jobs
+    StencilKernel stencilKernel;  /// < kernel used to update the plate rows
+    size_t timeBlockSteps;  /// < time steps per tile pass, 1 disables
+        /// temporal blocking
+    size_t tileRows;  /// < rows of a tile of the block mapping, 0 for auto
+    size_t tileCols;  /// < columns of a tile of the block mapping, 0 for auto
+    SchedulePolicy schedulePolicy;  /// < how the dynamic mapping hands out
+        /// blocks
+    short shouldPinThreads;  /// < indicates the workers are pinned to CPUs
+    short shouldSkipSteadyTiles;  /// < indicates steady tiles are skipped
+    short isMixedPrecision;  /// < indicates the first steps run in float
+    size_t checkpointIterations;  /// < iterations between checkpoints, 0 if
+        /// unused
+    double checkpointSeconds;  /// < seconds between checkpoints, 0 if unused
+    short shouldResume;  /// < indicates jobs restart from their checkpoints
+    short shouldCompress;  /// < indicates result plates are compressed
 } Arguments;
 
 /**
@@ -46,6 +76,7 @@ typedef struct {
     double plateCellDimmensions;  /// < dimensions of the plate cells
     double balancePoint;  /// < balance point of the plate
     char* directory;  /// < directory where the results will be written
+    size_t jobIndex;  /// < position of the job in the job file
 } JobData;
 
 /**
@@ -58,6 +89,49 @@ typedef struct {
     size_t iterations;  /// < number of iterations performed in the simulation
 } SimulationResult;
 
+/**
+ * @struct Tile
+ * @brief A rectangle of interior cells owned by one thread.
+ *
+ * Rows are in [startRow, endRow) and columns in [startCol, endCol), using
+ * plate coordinates.
+ */
+typedef struct {
+    size_t startRow;  /// < first row of the tile
+    size_t endRow;  /// < row after the last one of the tile
+    size_t startCol;  /// < first column of the tile
+    size_t endCol;  /// < column after the last one of the tile
+} Tile;
+
+/**
+ * @struct TilePlan
+ * @brief Splits the interior of a plate into a grid of equal tiles.
+ *
+ * Tiles are numbered row-major, the last tile of a row or column of tiles
+ * may be smaller.
+ */
+typedef struct {
+    size_t tileRows;  /// < rows owned by a tile
+    size_t tileCols;  /// < columns owned by a tile
+    size_t tilesPerRow;  /// < number of tiles along the columns
+    size_t tilesCount;  /// < number of tiles in the plate
+} TilePlan;
+
+/**
+ * @struct TimeBlocking
+ * @brief Splits the interior of a plate into overlapped tiles that advance
+ * several time steps per pass.
+ *
+ * Each tile is loaded with a halo of `steps` cells on every side. The halo
+ * shrinks one cell per step, so after `steps` steps the owned cells are
+ * exact without talking to other tiles. Halo cells are computed redundantly.
+ */
+typedef struct {
+    size_t steps;  /// < time steps advanced per pass
+    TilePlan tiles;  /// < tiles owned by the threads, halo excluded
+    size_t scratchSize;  /// < doubles in each of the two scratch buffers
+} TimeBlocking;
+
 /**
  * @struct SharedDate
  * @brief Structure representing shared data for threads.
@@ -67,17 +141,27 @@ typedef struct {
  */
 typedef struct {
     size_t threadCount;  /// < number of threads
+    const Plate* initialPlate;  /// < plate of the file, copied to both
+        /// plates by the threads that update them
     Plate* readPlate;  /// < current plate
     Plate* writePlate;  /// < new plate
     JobData jobData;  /// < job data
     size_t totalIterations;  /// < total number of iterations
-    pthread_mutex_t can_accsess_isBalanced;  /// < mutex for isBalanced
-    pthread_mutex_t barrierMutex;  /// < mutex for barrier
-    sem_t turnstile1;  /// < semaphore for barrier 1
-    sem_t turnstile2;  /// < semaphore for barrier 2
-    size_t barrierCount;  /// < number of threads that have reached the barrier
-    size_t currentCell;  /// < current cell being processed
-    pthread_mutex_t can_accsess_currentCell;  /// < mutex for currentCell
+    Barrier barrier;  /// < ends every iteration and reduces the balance
+    StencilKernel stencilKernel;  /// < kernel used to update the plate rows
+    TilePlan tilePlan;  /// < tiles of the block mapping
+    TimeBlocking timeBlocking;  /// < tiles of the temporal blocking engine
+    size_t blockSteps;  /// < time steps of the current tile pass
+    short isFinishing;  /// < indicates the pass stops at the balance step
+    double* stepDeltas;  /// < biggest change per thread and step of a pass
+    WorkQueue workQueue;  /// < blocks of the dynamic mapping
+    unsigned char* changedTiles[2];  /// < tiles that changed on even and
+        /// odd steps, NULL if every tile is always updated
+    float* floatCells[2];  /// < read and write plates of the single
+        /// precision steps
+    float floatThreshold;  /// < biggest change that ends the float steps
+    struct Checkpointer* checkpointer;  /// < saves snapshots of the read
+        /// plate, NULL if checkpoints are disabled
 } SharedData;
 
 // thread_private_data_t
@@ -0,0 +1,35 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h"
+
+/// First 8 bytes of a compressed plate file, "HEATZBIN" in little endian.
+/// As a row count it would need an exabyte file, so raw plates never match
+#define PLATE_CODEC_MAGIC UINT64_C(0x4e49425a54414548)
+
+/// Longest Huffman code, the decoder uses a table of 2^this entries
+#define CODEC_MAX_CODE_LENGTH 12
+
+/**
+ * @brief Tells whether a plate file is compressed.
+ *
+ * The format is written by the optimized version with --compress, this
+ * version only reads it.
+ *
+ * @param file The contents of the file.
+ * @param fileSize The size of the file in bytes.
+ * @return 1 if the file starts with PLATE_CODEC_MAGIC, 0 otherwise.
+ */
+int isCompressedPlate(const void* file, size_t fileSize);
+
+/**
+ * @brief Decodes a compressed plate file.
+ *
+ * @param file The contents of the file.
+ * @param fileSize The size of the file in bytes.
+ * @param threadCount The threads that decompress the blocks.
+ * @return The plate, or NULL if the file is corrupt.
+ */
+Plate* readCompressedPlate(const void* file, size_t fileSize,
+  size_t threadCount);
@@ -0,0 +1,306 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#define _GNU_SOURCE
+#include "jobs.h"
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "input.h"
+#include "output.h"
+#include "plate.h"
+#include "solution.h"
+
+/**
+ * @brief State shared by the reader, the simulation and the writer stages.
+ *
+ * The reader stays at most prefetchCount plates ahead of the started jobs,
+ * and stops while maxPendingPlates plates are read and not yet written, so
+ * a slow disk holds back the reader instead of filling the memory.
+ */
+typedef struct {
+    JobData* jobsData;  /// < the jobs
+    SimulationResult* results;  /// < result of every job, in job order
+    Plate** plates;  /// < plate of every read job that did not start yet
+    size_t jobsCount;  /// < number of jobs
+    size_t readCount;  /// < jobs whose plate was read
+    size_t startedCount;  /// < jobs handed to a runner
+    size_t pendingPlates;  /// < plates read and not yet written
+    size_t prefetchCount;  /// < plates read ahead of the started jobs
+    size_t maxPendingPlates;  /// < bound of pendingPlates
+    size_t* finishedJobs;  /// < finished jobs, in the order they ended
+    size_t finishedCount;  /// < number of finished jobs
+    size_t freeThreads;  /// < threads not assigned to any job
+    unsigned char* busySlots;  /// < thread slots of the budget in use, NULL
+        /// if the threads are not pinned
+    int* allowedCpus;  /// < CPUs the process may run on, in order
+    size_t allowedCount;  /// < number of allowed CPUs
+    pthread_mutex_t mutex;  /// < protects the counters and the arrays
+    pthread_cond_t plateRead;  /// < signaled when the reader loads a plate
+    pthread_cond_t slotFreed;  /// < signaled when the reader may go on
+    pthread_cond_t jobDone;  /// < signaled when a job releases its threads
+    pthread_cond_t resultReady;  /// < signaled when a job finishes
+} JobPipeline;
+
+/**
+ * @brief A job and the threads it got.
+ */
+typedef struct {
+    size_t jobIndex;  /// < index of the job
+    Plate* plate;  /// < initial plate of the job
+    Arguments args;  /// < arguments, threadsCount is the job share
+    size_t* slots;  /// < thread slots taken by the job, NULL if unpinned
+    int* cpus;  /// < CPU of every thread of the job, NULL if unpinned
+    JobPipeline* pipeline;  /// < receives the threads and the result
+} JobTask;
+
+static void* readPlates(void* data) {
+  JobPipeline* pipeline = (JobPipeline*) data;
+  for (size_t job = 0; job < pipeline->jobsCount; ++job) {
+    pthread_mutex_lock(&pipeline->mutex);
+    while (job - pipeline->startedCount >= pipeline->prefetchCount
+      || pipeline->pendingPlates >= pipeline->maxPendingPlates) {
+      pthread_cond_wait(&pipeline->slotFreed, &pipeline->mutex);
+    }
+    ++pipeline->pendingPlates;
+    pthread_mutex_unlock(&pipeline->mutex);
+
+    Plate* plate = readPlate(pipeline->jobsData[job].plateFile,
+      pipeline->jobsData[job].directory);
+
+    pthread_mutex_lock(&pipeline->mutex);
+    pipeline->plates[job] = plate;
+    pipeline->readCount = job + 1;
+    pthread_cond_signal(&pipeline->plateRead);
+    pthread_mutex_unlock(&pipeline->mutex);
+  }
+  return NULL;
+}
+
+static void* writeResults(void* data) {
+  JobPipeline* pipeline = (JobPipeline*) data;
+  ResultStream stream;
+  openResultStream(&stream, pipeline->jobsData, pipeline->results,
+    pipeline->jobsCount);
+
+  for (size_t written = 0; written < pipeline->jobsCount; ++written) {
+    pthread_mutex_lock(&pipeline->mutex);
+    while (pipeline->finishedCount == written) {
+      pthread_cond_wait(&pipeline->resultReady, &pipeline->mutex);
+    }
+    const size_t job = pipeline->finishedJobs[written];
+    pthread_mutex_unlock(&pipeline->mutex);
+
+    commitJobResult(&stream, job);
+    destroyPlate(pipeline->results[job].plate);
+    pipeline->results[job].plate = NULL;
+
+    pthread_mutex_lock(&pipeline->mutex);
+    --pipeline->pendingPlates;
+    pthread_cond_signal(&pipeline->slotFreed);
+    pthread_mutex_unlock(&pipeline->mutex);
+  }
+
+  closeResultStream(&stream);
+  return NULL;
+}
+
+static void* runJob(void* data) {
+  JobTask* task = (JobTask*) data;
+  JobPipeline* pipeline = task->pipeline;
+  const SimulationResult result = simulate(
+    pipeline->jobsData[task->jobIndex], task->plate, task->args, task->cpus);
+
+  pthread_mutex_lock(&pipeline->mutex);
+  pipeline->results[task->jobIndex] = result;
+  pipeline->freeThreads += task->args.threadsCount;
+  for (size_t i = 0; task->slots != NULL && i < task->args.threadsCount;
+    ++i) {
+    pipeline->busySlots[task->slots[i]] = 0;
+  }
+  pipeline->finishedJobs[pipeline->finishedCount++] = task->jobIndex;
+  pthread_cond_signal(&pipeline->jobDone);
+  pthread_cond_signal(&pipeline->resultReady);
+  pthread_mutex_unlock(&pipeline->mutex);
+  return NULL;
+}
+
+size_t calcJobThreads(size_t cells, size_t threadBudget) {
+  const size_t threads = (cells + MIN_CELLS_PER_THREAD - 1)
+    / MIN_CELLS_PER_THREAD;
+  if (threads == 0) {
+    return 1;
+  }
+  return threads < threadBudget ? threads : threadBudget;
+}
+
+size_t calcSlotCpu(PinPolicy policy, size_t slot, size_t slotCount,
+  size_t cpuCount) {
+  if (policy == PIN_SCATTER && slotCount < cpuCount) {
+    // the slots are evenly apart, a small budget still reaches every socket
+    return slot * cpuCount / slotCount;
+  }
+  return slot % cpuCount;
+}
+
+void pinCurrentThread(int cpu) {
+  cpu_set_t target;
+  CPU_ZERO(&target);
+  CPU_SET(cpu, &target);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(target), &target) != 0) {
+    fprintf(stderr, "Warning: could not pin thread to CPU %d\n", cpu);
+  }
+}
+
+// Lists the CPUs the process may run on, returns 0 if they are unknown
+static size_t listAllowedCpus(int** cpus) {
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    return 0;
+  }
+  *cpus = malloc(CPU_COUNT(&allowed) * sizeof(int));
+  assert(*cpus != NULL);
+  size_t count = 0;
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &allowed)) {
+      (*cpus)[count++] = cpu;
+    }
+  }
+  return count;
+}
+
+// Gives a job the first free thread slots and their CPUs, the mutex of the
+// pipeline must be locked
+static void takeThreadSlots(JobPipeline* pipeline, JobTask* task,
+  size_t threadBudget) {
+  task->slots = malloc(task->args.threadsCount * sizeof(size_t));
+  task->cpus = malloc(task->args.threadsCount * sizeof(int));
+  assert(task->slots != NULL && task->cpus != NULL);
+  size_t taken = 0;
+  for (size_t slot = 0; taken < task->args.threadsCount; ++slot) {
+    if (!pipeline->busySlots[slot]) {
+      pipeline->busySlots[slot] = 1;
+      task->slots[taken] = slot;
+      task->cpus[taken++] = pipeline->allowedCpus[calcSlotCpu(
+        task->args.pinPolicy, slot, threadBudget, pipeline->allowedCount)];
+    }
+  }
+}
+
+static void startStage(pthread_t* thread, void* (*routine)(void* data),
+  JobPipeline* pipeline) {
+  if (pthread_create(thread, NULL, routine, pipeline) != EXIT_SUCCESS) {
+    fprintf(stderr, "Error: could not create pipeline thread\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void runJobs(JobData* jobsData, SimulationResult* results, size_t jobsCount,
+  Arguments args) {
+  if (jobsCount == 0) {
+    return;
+  }
+  const size_t threadBudget = args.threadsCount;
+  JobPipeline pipeline;
+  pipeline.jobsData = jobsData;
+  pipeline.results = results;
+  pipeline.jobsCount = jobsCount;
+  pipeline.plates = calloc(jobsCount, sizeof(Plate*));
+  pipeline.finishedJobs = malloc(jobsCount * sizeof(size_t));
+  assert(pipeline.plates != NULL && pipeline.finishedJobs != NULL);
+  pipeline.readCount = 0;
+  pipeline.startedCount = 0;
+  pipeline.pendingPlates = 0;
+  pipeline.prefetchCount = args.prefetchCount;
+  // every thread may run a job, plus the prefetched plates
+  pipeline.maxPendingPlates = threadBudget + args.prefetchCount;
+  pipeline.finishedCount = 0;
+  pipeline.freeThreads = threadBudget;
+  pipeline.busySlots = NULL;
+  pipeline.allowedCpus = NULL;
+  pipeline.allowedCount = 0;
+  if (args.pinPolicy != PIN_NONE) {
+    pipeline.allowedCount = listAllowedCpus(&pipeline.allowedCpus);
+    if (pipeline.allowedCount > 0) {
+      pipeline.busySlots = calloc(threadBudget, 1);
+      assert(pipeline.busySlots != NULL);
+    } else {
+      fprintf(stderr, "Warning: unknown CPUs, the threads are not pinned\n");
+    }
+  }
+  pthread_mutex_init(&pipeline.mutex, NULL);
+  pthread_cond_init(&pipeline.plateRead, NULL);
+  pthread_cond_init(&pipeline.slotFreed, NULL);
+  pthread_cond_init(&pipeline.jobDone, NULL);
+  pthread_cond_init(&pipeline.resultReady, NULL);
+
+  JobTask* tasks = malloc(jobsCount * sizeof(JobTask));
+  assert(tasks != NULL);
+  pthread_attr_t attributes;
+  pthread_attr_init(&attributes);
+  pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+
+  pthread_t reader, writer;
+  startStage(&reader, readPlates, &pipeline);
+  startStage(&writer, writeResults, &pipeline);
+
+  for (size_t i = 0; i < jobsCount; i++) {
+    pthread_mutex_lock(&pipeline.mutex);
+    while (pipeline.readCount <= i) {
+      pthread_cond_wait(&pipeline.plateRead, &pipeline.mutex);
+    }
+    tasks[i].jobIndex = i;
+    tasks[i].plate = pipeline.plates[i];
+    pipeline.plates[i] = NULL;
+    tasks[i].args = args;
+    tasks[i].args.threadsCount = calcJobThreads(tasks[i].plate->rows
+      * tasks[i].plate->cols, threadBudget);
+    tasks[i].pipeline = &pipeline;
+
+    // jobs start in order, so a big plate is not starved by small ones
+    while (pipeline.freeThreads < tasks[i].args.threadsCount) {
+      pthread_cond_wait(&pipeline.jobDone, &pipeline.mutex);
+    }
+    pipeline.freeThreads -= tasks[i].args.threadsCount;
+    tasks[i].slots = NULL;
+    tasks[i].cpus = NULL;
+    if (pipeline.busySlots != NULL) {
+      takeThreadSlots(&pipeline, &tasks[i], threadBudget);
+    }
+    pipeline.startedCount = i + 1;
+    pthread_cond_signal(&pipeline.slotFreed);
+    pthread_mutex_unlock(&pipeline.mutex);
+
+    pthread_t runner;
+    if (pthread_create(&runner, &attributes, runJob, &tasks[i])
+      != EXIT_SUCCESS) {
+      fprintf(stderr, "Error: could not create job thread\n");
+      runJob(&tasks[i]);
+    }
+  }
+
+  pthread_join(reader, NULL);
+  pthread_join(writer, NULL);
+  // every job gives its threads back when it ends
+  pthread_mutex_lock(&pipeline.mutex);
+  while (pipeline.freeThreads < threadBudget) {
+    pthread_cond_wait(&pipeline.jobDone, &pipeline.mutex);
+  }
+  pthread_mutex_unlock(&pipeline.mutex);
+
+  pthread_attr_destroy(&attributes);
+  pthread_cond_destroy(&pipeline.resultReady);
+  pthread_cond_destroy(&pipeline.jobDone);
+  pthread_cond_destroy(&pipeline.slotFreed);
+  pthread_cond_destroy(&pipeline.plateRead);
+  pthread_mutex_destroy(&pipeline.mutex);
+  for (size_t i = 0; i < jobsCount; i++) {
+    free(tasks[i].slots);
+    free(tasks[i].cpus);
+  }
+  free(pipeline.busySlots);
+  free(pipeline.allowedCpus);
+  free(pipeline.plates);
+  free(pipeline.finishedJobs);
+  free(tasks);
+}
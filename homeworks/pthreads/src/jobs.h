@@ -0,0 +1,69 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#pragma once
+#include <stddef.h>
+#include "types.h"
+
+/// Plates read ahead of the running jobs by default
+#define DEFAULT_PREFETCH_COUNT 2
+
+/// Cells worth one more thread, smaller plates get fewer threads
+#define MIN_CELLS_PER_THREAD (64 * 1024)
+
+/**
+ * @brief Calculates how many threads a plate should get.
+ *
+ * Gives a thread per MIN_CELLS_PER_THREAD cells, so tiny plates run on a
+ * single thread instead of paying barrier overhead for idle threads.
+ *
+ * @param cells The number of cells of the plate.
+ * @param threadBudget The number of threads of the process.
+ * @return A number of threads between 1 and threadBudget.
+ */
+size_t calcJobThreads(size_t cells, size_t threadBudget);
+
+/**
+ * @brief Chooses the CPU of a thread slot.
+ *
+ * The budget of threads is a set of slots, every running thread holds one.
+ * Compact puts slot i on the i-th allowed CPU, scatter spreads the slots
+ * evenly over the allowed CPUs, so a budget smaller than the machine still
+ * uses every socket when the CPUs are numbered socket by socket.
+ *
+ * @param policy The pinning policy, compact or scatter.
+ * @param slot The thread slot.
+ * @param slotCount The number of slots, the thread budget.
+ * @param cpuCount The number of allowed CPUs.
+ * @return The index of the CPU among the allowed ones.
+ */
+size_t calcSlotCpu(PinPolicy policy, size_t slot, size_t slotCount,
+  size_t cpuCount);
+
+/**
+ * @brief Pins the calling thread to a CPU.
+ *
+ * Prints a warning if the CPU cannot be used, the thread goes on unpinned.
+ *
+ * @param cpu The CPU number.
+ */
+void pinCurrentThread(int cpu);
+
+/**
+ * @brief Simulates several jobs at once and writes their results.
+ *
+ * Runs a three stage pipeline: a reader thread loads the plates ahead of
+ * the simulation, jobs are started in order as soon as there are enough
+ * free threads for them, each one in its own runner thread, and a writer
+ * thread writes every final plate as soon as its job ends, along with the
+ * TSV lines of the jobs finished so far. At most threadsCount plus
+ * prefetchCount plates are in memory at once. Returns when every result
+ * was written. With a pin policy, every job takes free thread slots and
+ * its threads are pinned to their CPUs.
+ *
+ * @param jobsData The jobs.
+ * @param results Receives the result of every job, in job order. The plates
+ * are freed once written, so they are left NULL.
+ * @param jobsCount The number of jobs.
+ * @param args The arguments, threadsCount is the budget of all the jobs.
+ */
+void runJobs(JobData* jobsData, SimulationResult* results, size_t jobsCount,
+  Arguments args);
@@ -9,8 +9,11 @@
 #include <math.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/mman.h>
 
 #include "input.h"
+#include "jobs.h"
+#include "plate.h"
 #include "solution.h"
 #include "output.h"
 
@@ -23,18 +26,16 @@ int main(int argc, char** argv) {
     struct timespec start, end;
   clock_gettime(CLOCK_MONOTONIC, &start);
   Arguments args = processArguments(argc, argv);
-  JobData* jobsData = readJobData(args.jobFile);
-  size_t jobsCount = calcFileLinesCount(args.jobFile);
+  size_t jobsCount = 0;
+  JobData* jobsData = readJobData(args.jobFile, &jobsCount);
   SimulationResult* results = malloc(jobsCount * sizeof(SimulationResult));
   assert(results != NULL);
-  for (size_t i = 0; i < jobsCount; i++) {
-    results[i] = processJob(jobsData[i], args);
-  }
-
-  writeJobsResult(jobsData, results, jobsCount, "output.txt");
+  // several jobs run at once, each one with a share of the threads, and
+  // their results are written as they end
+  runJobs(jobsData, results, jobsCount, args);
 
   // free memory
-  destroyJobsData(jobsData, jobsCount);
+  destroyJobsData(jobsData);
   destroySimulationResult(results, jobsCount);
 
   clock_gettime(CLOCK_MONOTONIC, &end);
@@ -47,17 +48,21 @@ int main(int argc, char** argv) {
 
 SimulationResult processJob(JobData jobData, Arguments args) {
   Plate* plate = readPlate(jobData.plateFile, jobData.directory);
-  SimulationResult result = simulate(jobData, plate, args);
+  SimulationResult result = simulate(jobData, plate, args, NULL);
   return result;
 }
 
-SimulationResult simulate(JobData jobData, Plate* plate, Arguments args) {
-  Plate* readPlate = copyPlate(plate);
-  Plate* writePlate = plate;
-  const size_t totalCells = readPlate->rows * readPlate->cols;
+SimulationResult simulate(JobData jobData, Plate* plate, Arguments args,
+  const int* threadCpus) {
+  // both plates are filled by the threads that update them, see
+  // calcNewTemperature, the plate of the file is only read
+  const size_t stride = calcPlateStride(plate->cols);
+  const size_t totalCells = plate->rows * plate->cols;
   SharedData* sharedData = malloc(sizeof(SharedData));
-  sharedData->readPlate = readPlate;
-  sharedData->writePlate = writePlate;
+  sharedData->initialPlate = plate;
+  sharedData->threadCpus = threadCpus;
+  sharedData->readPlate = allocatePlate(plate->rows, plate->cols, stride);
+  sharedData->writePlate = allocatePlate(plate->rows, plate->cols, stride);
   sharedData->threadCount = args.threadsCount > totalCells ? totalCells
     : args.threadsCount;
   sharedData->jobData = jobData;
@@ -81,21 +86,69 @@ SimulationResult simulate(JobData jobData, Plate* plate, Arguments args) {
     sem_destroy(&sharedData->turnstile2);
 
     
+  // the last state is always in the write plate, which may be any of the two
   SimulationResult result;
-  result.plate = writePlate;
+  result.plate = sharedData->writePlate;
   result.iterations = sharedData->totalIterations + 1;
 
   // free memory
-  destroyPlate(readPlate);
+  destroyPlate(sharedData->readPlate);
+  destroyPlate(plate);
   free(sharedData);
   return result;
 }
 
+// Decides whether the plate is balanced, run by the last thread to arrive
+static void finishIteration(SharedData* sharedData) {
+    pthread_mutex_lock(&sharedData->can_accsess_isBalanced);
+    if (sharedData->writePlate->isBalanced) {
+      sharedData->writePlate->isBalanced = 2;
+    } else {
+      sharedData->writePlate->isBalanced = 1;
+      // swap plates
+      Plate* temp = sharedData->readPlate;
+      sharedData->readPlate = sharedData->writePlate;
+      sharedData->writePlate = temp;
+      sharedData->totalIterations++;
+    }
+    pthread_mutex_unlock(&sharedData->can_accsess_isBalanced);
+}
+
+// Reusable barrier of two turnstiles, the last thread to arrive runs the
+// action, if any, before the others go on
+static void waitTeam(SharedData* sharedData,
+  void (*action)(SharedData* sharedData)) {
+    pthread_mutex_lock(&sharedData->barrierMutex);
+    if (++sharedData->barrierCount == sharedData->threadCount) {
+        sem_wait(&sharedData->turnstile2);
+        sem_post(&sharedData->turnstile1);
+        if (action) {
+            action(sharedData);
+        }
+    }
+    pthread_mutex_unlock(&sharedData->barrierMutex);
+    sem_wait(&sharedData->turnstile1); // Esperar a que todos los hilos lleguen
+    sem_post(&sharedData->turnstile1); // Despertar a los demás hilos
+
+    pthread_mutex_lock(&sharedData->barrierMutex);
+    if (--sharedData->barrierCount == 0) {
+        sem_wait(&sharedData->turnstile1);
+        sem_post(&sharedData->turnstile2);
+    }
+    pthread_mutex_unlock(&sharedData->barrierMutex);
+
+    sem_wait(&sharedData->turnstile2);
+    sem_post(&sharedData->turnstile2);
+}
+
 void* calcNewTemperature(void* data) {
     const struct private_data* privateData = (struct private_data*)data;
     SharedData* sharedData = (SharedData*) privateData->data;
 
     const size_t threadCount = privateData->thread_count;
+    if (sharedData->threadCpus != NULL) {
+        pinCurrentThread(sharedData->threadCpus[privateData->thread_number]);
+    }
 
     const JobData jobData = sharedData->jobData;
     const double factor = (jobData.duration * jobData.thermalDiffusivity) /
@@ -119,9 +172,19 @@ void* calcNewTemperature(void* data) {
         endRow = startRow + rowsPerThread;
     }
 
+    // first touch: the thread copies the rows it updates, so their pages
+    // land on its NUMA node, and waits for the rows of its neighbors
+    copyPlateRows(sharedData->initialPlate, sharedData->readPlate, startRow,
+      endRow);
+    copyPlateRows(sharedData->initialPlate, sharedData->writePlate, startRow,
+      endRow);
+    waitTeam(sharedData, NULL);
+
+    const size_t stride = sharedData->readPlate->stride;
+
     while(1) {
-        double** currentPlateData = sharedData->readPlate->data;
-        double** newPlateData = sharedData->writePlate->data;
+        const double* currentPlateData = sharedData->readPlate->data;
+        double* newPlateData = sharedData->writePlate->data;
         int localIsBalanced = 1;
 
         if (sharedData->writePlate->isBalanced == 2) {
@@ -131,16 +194,18 @@ void* calcNewTemperature(void* data) {
         // --------------------------
         // Procesar las celdas en el rango de filas asignadas al hilo
         for (size_t row = startRow; row < endRow; ++row) {
+            const double* current = currentPlateData + row * stride;
+            double* next = newPlateData + row * stride;
             for (size_t col = 1; col < cols - 1; ++col) {
                 if (row > 0 && row < rows - 1) {
-                    double left = currentPlateData[row][col - 1];
-                    double right = currentPlateData[row][col + 1];
-                    double up = currentPlateData[row - 1][col];
-                    double down = currentPlateData[row + 1][col];
-                    double cell = currentPlateData[row][col];
+                    double left = current[col - 1];
+                    double right = current[col + 1];
+                    double up = current[col - stride];
+                    double down = current[col + stride];
+                    double cell = current[col];
 
                     double newTemperature = cell + factor * (left + right + up + down - 4 * cell);
-                    newPlateData[row][col] = newTemperature;
+                    next[col] = newTemperature;
 
                     if (fabs(newTemperature - cell) > jobData.balancePoint) {
                         localIsBalanced = 0;  // No está balanceado
@@ -154,36 +219,7 @@ void* calcNewTemperature(void* data) {
         pthread_mutex_unlock(&sharedData->can_accsess_isBalanced);
 
         // Esperar a que todos los hilos terminen
-        pthread_mutex_lock(&sharedData->barrierMutex);
-        if (++sharedData->barrierCount == sharedData->threadCount) {
-            sem_wait(&sharedData->turnstile2);
-            sem_post(&sharedData->turnstile1);
-            pthread_mutex_lock(&sharedData->can_accsess_isBalanced);
-            if (sharedData->writePlate->isBalanced) {
-              sharedData->writePlate->isBalanced = 2;
-            } else {
-              sharedData->writePlate->isBalanced = 1;
-              // swap plates
-              Plate* temp = sharedData->readPlate;
-              sharedData->readPlate = sharedData->writePlate;
-              sharedData->writePlate = temp;
-              sharedData->totalIterations++;
-            }
-            pthread_mutex_unlock(&sharedData->can_accsess_isBalanced);
-        }
-        pthread_mutex_unlock(&sharedData->barrierMutex);
-        sem_wait(&sharedData->turnstile1); // Esperar a que todos los hilos lleguen
-        sem_post(&sharedData->turnstile1); // Despertar a los demás hilos
-
-        pthread_mutex_lock(&sharedData->barrierMutex);
-        if (--sharedData->barrierCount == 0) {
-            sem_wait(&sharedData->turnstile1);
-            sem_post(&sharedData->turnstile2);
-        }
-        pthread_mutex_unlock(&sharedData->barrierMutex);
-
-        sem_wait(&sharedData->turnstile2);
-        sem_post(&sharedData->turnstile2);
+        waitTeam(sharedData, finishIteration);
     }
 
     return NULL;
@@ -191,40 +227,33 @@ void* calcNewTemperature(void* data) {
 
 
 Plate* copyPlate(Plate* plate) {
-  Plate* newPlate = malloc(sizeof(Plate));
-  newPlate->rows = plate->rows;
-  newPlate->cols = plate->cols;
+  Plate* newPlate = createPlateStrided(plate->rows, plate->cols,
+    plate->stride);
   newPlate->isBalanced = plate->isBalanced;
-  newPlate->data = malloc(newPlate->rows * sizeof(double*));
-  for (size_t i = 0; i < newPlate->rows; i++) {
-    newPlate->data[i] = malloc(newPlate->cols * sizeof(double));
-    memcpy(newPlate->data[i], plate->data[i], newPlate->cols * sizeof(double));
-  }
+  memcpy(newPlate->data, plate->data,
+    plate->rows * plate->stride * sizeof(double));
   return newPlate;
 }
 
 void copyPlateBorders(Plate original, Plate copy) {
   // top
-  for (size_t colIndex = 0; colIndex < original.cols; colIndex++) {
-    copy.data[0][colIndex] = original.data[0][colIndex];
-  }
+  memcpy(PLATE_ROW(&copy, 0), PLATE_ROW(&original, 0),
+    original.cols * sizeof(double));
 
   // left
   for (size_t rowIndex = 0; rowIndex < original.rows; rowIndex++) {
-    copy.data[rowIndex][0] = original.data[rowIndex][0];
+    PLATE_ROW(&copy, rowIndex)[0] = PLATE_ROW(&original, rowIndex)[0];
   }
 
   // right
   for (size_t rowIndex = 0; rowIndex < original.rows; rowIndex++) {
-    copy.data[rowIndex][original.cols - 1]
-      = original.data[rowIndex][original.cols - 1];
+    PLATE_ROW(&copy, rowIndex)[original.cols - 1]
+      = PLATE_ROW(&original, rowIndex)[original.cols - 1];
   }
 
   // bottom
-  for (size_t colIndex = 0; colIndex < original.cols; colIndex++) {
-    copy.data[original.rows - 1][colIndex]
-      = original.data[original.rows - 1][colIndex];
-  }
+  memcpy(PLATE_ROW(&copy, original.rows - 1),
+    PLATE_ROW(&original, original.rows - 1), original.cols * sizeof(double));
 }
 
 
@@ -248,25 +277,25 @@ void format_time(time_t seconds, char *buffer, size_t buffer_size) {
       months, days, hours, minutes, secs);
 }
 
-void destroyJobsData(JobData *jobsData, size_t jobsCount) {
-    for (size_t i = 0; i < jobsCount; i++) {
-        free(jobsData[i].plateFile);
-        free(jobsData[i].directory);
-    }
+void destroyJobsData(JobData *jobsData) {
+    // the strings of the jobs are in the same block
     free(jobsData);
 }
 
 void destroyPlate(Plate* plate) {
-  for (size_t i = 0; i < plate->rows; i++) {
-    free(plate->data[i]);
+  if (plate->mappedSize > 0) {
+    munmap((char*) plate->data - PLATE_HEADER_SIZE, plate->mappedSize);
+  } else {
+    free(plate->data);
   }
-  free(plate->data);
   free(plate);
 }
 
 void destroySimulationResult(SimulationResult* results, size_t resultsCount) {
     for (size_t i = 0; i < resultsCount; i++) {
-        destroyPlate(results[i].plate);
+        if (results[i].plate != NULL) {
+            destroyPlate(results[i].plate);
+        }
     }
     free(results);
 }
@@ -21,11 +21,13 @@ SimulationResult processJob(JobData jobData, Arguments args);
  * Simulates the given job data on the specified plate.
  *
  * @param jobData The job data to be simulated.
- * @param plate The plate on which the simulation will be performed.
+ * @param plate The initial plate, freed by the simulation.
  * @param args The arguments for the simulation.
+ * @param threadCpus The CPU of every thread, NULL to leave them unpinned.
  * @return The result of the simulation.
  */
-SimulationResult simulate(JobData jobData, Plate* plate, Arguments args);
+SimulationResult simulate(JobData jobData, Plate* plate, Arguments args,
+  const int* threadCpus);
 
 /**
  * @brief Creates a copy of a Plate object.
@@ -74,14 +76,11 @@ void* calcNewTemperature(void* data);
  * @brief Destroys the JobData array and frees the memory.
  *
  * This function is responsible for deallocating the memory used by the JobData array.
- * It takes a pointer to the JobData array and the number of jobs as parameters.
- * The function frees the memory allocated for each JobData element and then frees the memory
- * allocated for the JobData array itself.
+ * The array and the strings of its jobs are a single block.
  *
- * @param jobsData Pointer to the JobData array.
- * @param jobsCount Number of jobs in the array.
+ * @param jobsData Pointer to the JobData array, as returned by readJobData.
  */
-void destroyJobsData(JobData *jobsData, size_t jobsCount);
+void destroyJobsData(JobData *jobsData);
 /**
  * @brief Destroys a Plate object.
  *
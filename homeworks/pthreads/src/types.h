@@ -7,15 +7,33 @@
 
 /**
  * @brief Structure representing a plate with data, number of rows, and number of columns.
+ *
+ * Cell (row, col) is stored at data[row * stride + col]. Allocated plates
+ * keep their cells in one 64-byte aligned buffer with padded rows. A plate
+ * loaded with mmap points into the file mapping, right after the header,
+ * so it is only 8-byte aligned and its stride is cols.
  */
 
 typedef struct  {
-    double** data;  /// < matrix of doubles representing the plate
+    double* data;  /// < row-major cells, 64-byte aligned unless mapped
+        /// from a file
     short isBalanced;  /// < indicates if the plate is balanced
     size_t rows;  /// < number of rows in the plate
     size_t cols;  /// < number of columns in the plate
+    size_t stride;  /// < row length in doubles, padded unless mapped
+        /// from a file, where it equals cols
+    size_t mappedSize;  /// < bytes of the mapped file, 0 if data is allocated
 } Plate;
 
+/**
+ * @brief Where the threads of the jobs run.
+ */
+typedef enum {
+  PIN_NONE,  /// < the threads are not pinned
+  PIN_COMPACT,  /// < thread slot i runs on the i-th allowed CPU
+  PIN_SCATTER  /// < the thread slots are spread over the allowed CPUs
+} PinPolicy;
+
 /**
  * @struct Arguments
  * @brief Represents the arguments of the program such as the job file path and the number of threads.
@@ -29,6 +47,8 @@ typedef struct {
     short shloudPrintIterations;  /// < indicates if the program
         /// should print the
         /// number of iterations counted in the simulation
+    size_t prefetchCount;  /// < plates read ahead of the running jobs
+    PinPolicy pinPolicy;  /// < where the threads of the jobs run
 } Arguments;
 
 /**
@@ -67,6 +87,9 @@ typedef struct {
  */
 typedef struct {
     size_t threadCount;  /// < number of threads
+    const Plate* initialPlate;  /// < plate of the file, copied to both
+        /// plates by the threads that update them
+    const int* threadCpus;  /// < CPU of every thread, NULL if not pinned
     Plate* readPlate;  /// < current plate
     Plate* writePlate;  /// < new plate
     JobData jobData;  /// < job data
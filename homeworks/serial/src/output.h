@@ -1,5 +1,6 @@
 // Copyright <2024> <Aaron Santana Valdelomar - UCR>
 #pragma once
+#include <stdio.h>
 #include <time.h>
 #include "types.h"
 
@@ -12,15 +13,71 @@
 void writePlate(Plate plate, const char* binaryFilpath);
 
 /**
- * Writes the results of the jobs to a file.
+ * @struct ResultStream
+ * @brief Writes the results of a job file as the jobs finish.
  *
- * @param jobsData The array of JobData containing the job information.
- * @param results The array of SimulationResult containing the simulation results.
+ * Plates are written as soon as their job is committed, while the TSV lines
+ * are held back until every previous job is committed, so the file keeps
+ * the job order whatever the order the jobs end in.
+ */
+typedef struct {
+    FILE* file;  /// < the TSV file
+    const JobData* jobsData;  /// < the jobs
+    const SimulationResult* results;  /// < result of every job, in job order
+    size_t jobsCount;  /// < number of jobs
+    size_t nextLine;  /// < first job whose line is not written yet
+    unsigned char* isDone;  /// < whether every job was committed
+} ResultStream;
+
+/**
+ * @brief Creates the TSV file of a job file and starts streaming to it.
+ *
+ * @param stream The stream to initialize.
+ * @param jobsData The jobs, at least one.
+ * @param results Where the results of the jobs are stored as they end.
  * @param jobsCount The number of jobs.
- * @param filepath The path of the file to write the results to.
  */
-void writeJobsResult(JobData* jobsData, SimulationResult* results,
-  size_t jobsCount, char* filepath);
+void openResultStream(ResultStream* stream, const JobData* jobsData,
+  const SimulationResult* results, size_t jobsCount);
+
+/**
+ * @brief Writes the plate of a finished job and every TSV line now in order.
+ *
+ * The plate may be freed once this returns, the lines only need the
+ * iterations of the result.
+ *
+ * @param stream The stream.
+ * @param jobIndex The job, its result must already be stored.
+ */
+void commitJobResult(ResultStream* stream, size_t jobIndex);
+
+/**
+ * @brief Closes the TSV file of a stream.
+ *
+ * @param stream The stream.
+ */
+void closeResultStream(ResultStream* stream);
+
+/**
+ * @brief Creates the TSV file of the results of a job file.
+ *
+ * The file is named after the numbers of the first plate, next to it.
+ *
+ * @param jobsData The jobs, at least one.
+ * @return The open file, the program exits if it cannot be created.
+ */
+FILE* openJobsResult(const JobData* jobsData);
+
+/**
+ * @brief Writes the final plate of a job next to its initial plate.
+ *
+ * The file is named <plate>-<iterations>.bin.
+ *
+ * @param jobData The data of the job.
+ * @param result The simulation result.
+ */
+void writeResultPlate(JobData jobData, SimulationResult result);
+
 /**
  * Writes the result of a job to a file.
  *
@@ -0,0 +1,40 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#include "plate.h"
+#include <stdio.h>
+#include <string.h>
+
+size_t calcPlateStride(size_t cols) {
+  const size_t cellsPerLine = PLATE_ALIGNMENT / sizeof(double);
+  return (cols + cellsPerLine - 1) / cellsPerLine * cellsPerLine;
+}
+
+Plate createPlate(size_t rows, size_t cols) {
+  return createPlateStrided(rows, cols, calcPlateStride(cols));
+}
+
+Plate createPlateStrided(size_t rows, size_t cols, size_t stride) {
+  Plate plate;
+  plate.rows = rows;
+  plate.cols = cols;
+  plate.stride = stride;
+  plate.isBalanced = 0;
+  plate.mappedSize = 0;
+  // aligned_alloc wants a multiple of the alignment, any stride may be given
+  size_t size = rows * plate.stride * sizeof(double);
+  size = (size + PLATE_ALIGNMENT - 1) / PLATE_ALIGNMENT * PLATE_ALIGNMENT;
+  plate.data = aligned_alloc(PLATE_ALIGNMENT, size > 0 ? size
+    : PLATE_ALIGNMENT);
+  if (plate.data == NULL) {
+    fprintf(stderr, "Error: could not allocate a %zux%zu plate\n", rows, cols);
+    exit(EXIT_FAILURE);
+  }
+
+  // clean the padding so whole-buffer copies never read garbage
+  if (plate.stride != cols) {
+    for (size_t row = 0; row < rows; row++) {
+      memset(PLATE_ROW(&plate, row) + cols, 0,
+        (plate.stride - cols) * sizeof(double));
+    }
+  }
+  return plate;
+}
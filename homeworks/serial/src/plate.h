@@ -0,0 +1,49 @@
+// Copyright <2024> <Aaron Santana Valdelomar - UCR>
+#pragma once
+#include <stdlib.h>
+#include "types.h"
+
+/// Alignment in bytes of the plate buffer and of the start of every row
+#define PLATE_ALIGNMENT 64
+
+/// Bytes before the cells in a plate file, the rows and cols counts
+#define PLATE_HEADER_SIZE (2 * sizeof(size_t))
+
+/// Pointer to the first cell of the given row of a plate
+#define PLATE_ROW(plate, row) ((plate)->data + (row) * (plate)->stride)
+
+/**
+ * @brief Calculates the padded length of a plate row.
+ *
+ * Rows are padded up to a multiple of PLATE_ALIGNMENT bytes so every row of
+ * the contiguous buffer starts on a cache line boundary.
+ *
+ * @param cols The number of columns of the plate.
+ * @return The number of doubles between the start of two consecutive rows.
+ */
+size_t calcPlateStride(size_t cols);
+
+/**
+ * @brief Creates a plate backed by a single contiguous, aligned buffer.
+ *
+ * The cells are stored row-major with a padded stride. The padding at the end
+ * of each row is zeroed, the cells are left uninitialized.
+ *
+ * @param rows The number of rows of the plate.
+ * @param cols The number of columns of the plate.
+ * @return The new plate.
+ */
+Plate createPlate(size_t rows, size_t cols);
+
+/**
+ * @brief Creates a plate with the given row stride.
+ *
+ * Same as createPlate, for a plate that must share the layout of another
+ * one, e.g. the write plate of a plate mapped from its file.
+ *
+ * @param rows The number of rows of the plate.
+ * @param cols The number of columns of the plate.
+ * @param stride The number of doubles between two rows, at least cols.
+ * @return The new plate.
+ */
+Plate createPlateStrided(size_t rows, size_t cols, size_t stride);
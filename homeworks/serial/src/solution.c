@@ -8,7 +8,9 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include "input.h"
+#include "plate.h"
 #include "solution.h"
 #include "output.h"
 
@@ -22,19 +24,23 @@ int main(int argc, char** argv) {
   struct timespec start, end;
   clock_gettime(CLOCK_MONOTONIC, &start);
   Arguments args = processArguments(argc, argv);
-  JobData* jobsData = readJobData(args.jobFile);
-  size_t jobsCount = calcFileLinesCount(args.jobFile);
+  size_t jobsCount = 0;
+  JobData* jobsData = readJobData(args.jobFile, &jobsCount);
   SimulationResult* results = malloc(jobsCount * sizeof(SimulationResult));
   assert(results != NULL);
-  // print jpbs count
+  // every result is written and freed as soon as its job ends
+  ResultStream stream;
+  openResultStream(&stream, jobsData, results, jobsCount);
   for (size_t i = 0; i < jobsCount; i++) {
     results[i] = processJob(jobsData[i]);
+    commitJobResult(&stream, i);
+    destroyPlate(results[i].plate);
+    results[i].plate.data = NULL;
   }
-
-  writeJobsResult(jobsData, results, jobsCount, "output.txt");
+  closeResultStream(&stream);
 
   // free memory
-  destroyJobsData(jobsData, jobsCount);
+  destroyJobsData(jobsData);
   destroySimulationResult(results, jobsCount);
 
   clock_gettime(CLOCK_MONOTONIC, &end);
@@ -72,29 +78,25 @@ SimulationResult simulate(JobData jobData, Plate plate) {
 }
 
 Plate simulationIteration(JobData jobData, Plate plate) {
-  Plate newPlate;
-  newPlate.rows = plate.rows;
-  newPlate.cols = plate.cols;
-  newPlate.isBalanced = 1;
-
   // Allocate memory for the new plate
-  newPlate.data = (double **)malloc(plate.rows * sizeof(double *));
-  for (size_t i = 0; i < plate.rows; i++) {
-    newPlate.data[i] = (double *)malloc(plate.cols * sizeof(double));
-  }
+  Plate newPlate = createPlate(plate.rows, plate.cols);
+  newPlate.isBalanced = 1;
   copyPlateBorders(plate, newPlate);
 
+  const size_t stride = plate.stride;
   for (size_t i = 1; i < plate.rows - 1; i++) {
+    const double* current = PLATE_ROW(&plate, i);
+    double* next = PLATE_ROW(&newPlate, i);
     for (size_t j = 1; j < plate.cols - 1; j++) {
-      double left = plate.data[i][j - 1];
-      double right = plate.data[i][j + 1];
-      double up = plate.data[i - 1][j];
-      double down = plate.data[i + 1][j];
-      double cell = plate.data[i][j];
+      double left = current[j - 1];
+      double right = current[j + 1];
+      double up = current[j - stride];
+      double down = current[j + stride];
+      double cell = current[j];
       double newTemperature = cell + ((jobData.duration * jobData
       .thermalDiffusivity) / (jobData.plateCellDimmensions *
         jobData.plateCellDimmensions)) * (left + right + up + down - 4 * cell);
-      newPlate.data[i][j] = newTemperature;
+      next[j] = newTemperature;
       if ((newTemperature - cell) > jobData.balancePoint) {
         newPlate.isBalanced = 0;
       }
@@ -105,26 +107,23 @@ Plate simulationIteration(JobData jobData, Plate plate) {
 
 void copyPlateBorders(Plate original, Plate copy) {
   // top
-  for (size_t colIndex = 0; colIndex < original.cols; colIndex++) {
-    copy.data[0][colIndex] = original.data[0][colIndex];
-  }
+  memcpy(PLATE_ROW(&copy, 0), PLATE_ROW(&original, 0),
+    original.cols * sizeof(double));
 
   // left
   for (size_t rowIndex = 0; rowIndex < original.rows; rowIndex++) {
-    copy.data[rowIndex][0] = original.data[rowIndex][0];
+    PLATE_ROW(&copy, rowIndex)[0] = PLATE_ROW(&original, rowIndex)[0];
   }
 
   // right
   for (size_t rowIndex = 0; rowIndex < original.rows; rowIndex++) {
-    copy.data[rowIndex][original.cols - 1]
-      = original.data[rowIndex][original.cols - 1];
+    PLATE_ROW(&copy, rowIndex)[original.cols - 1]
+      = PLATE_ROW(&original, rowIndex)[original.cols - 1];
   }
 
   // bottom
-  for (size_t colIndex = 0; colIndex < original.cols; colIndex++) {
-    copy.data[original.rows - 1][colIndex]
-      = original.data[original.rows - 1][colIndex];
-  }
+  memcpy(PLATE_ROW(&copy, original.rows - 1),
+    PLATE_ROW(&original, original.rows - 1), original.cols * sizeof(double));
 }
 
 
@@ -148,24 +147,24 @@ void format_time(time_t seconds, char *buffer, size_t buffer_size) {
       months, days, hours, minutes, secs);
 }
 
-void destroyJobsData(JobData *jobsData, size_t jobsCount) {
-    for (size_t i = 0; i < jobsCount; i++) {
-        free(jobsData[i].plateFile);
-        free(jobsData[i].directory);
-    }
+void destroyJobsData(JobData *jobsData) {
+    // the strings of the jobs are in the same block
     free(jobsData);
 }
 
 void destroyPlate(Plate plate) {
-  for (size_t i = 0; i < plate.rows; i++) {
-    free(plate.data[i]);
+  if (plate.mappedSize > 0) {
+    munmap((char*) plate.data - PLATE_HEADER_SIZE, plate.mappedSize);
+  } else {
+    free(plate.data);
   }
-  free(plate.data);
 }
 
 void destroySimulationResult(SimulationResult* results, size_t resultsCount) {
     for (size_t i = 0; i < resultsCount; i++) {
-        destroyPlate(results[i].plate);
+        if (results[i].plate.data != NULL) {
+            destroyPlate(results[i].plate);
+        }
     }
     free(results);
 }
@@ -50,14 +50,11 @@ Plate simulationIteration(JobData JobData, Plate plate);
  * @brief Destroys the JobData array and frees the memory.
  *
  * This function is responsible for deallocating the memory used by the JobData array.
- * It takes a pointer to the JobData array and the number of jobs as parameters.
- * The function frees the memory allocated for each JobData element and then frees the memory
- * allocated for the JobData array itself.
+ * The array and the strings of its jobs are a single block.
  *
- * @param jobsData Pointer to the JobData array.
- * @param jobsCount Number of jobs in the array.
+ * @param jobsData Pointer to the JobData array, as returned by readJobData.
  */
-void destroyJobsData(JobData *jobsData, size_t jobsCount);
+void destroyJobsData(JobData *jobsData);
 /**
  * @brief Destroys a Plate object.
  *
@@ -5,13 +5,22 @@
 
 /**
  * @brief Structure representing a plate with data, number of rows, and number of columns.
+ *
+ * Cell (row, col) is stored at data[row * stride + col]. Allocated plates
+ * keep their cells in one 64-byte aligned buffer with padded rows. A plate
+ * loaded with mmap points into the file mapping, right after the header,
+ * so it is only 8-byte aligned and its stride is cols.
  */
 
 typedef struct  {
-    double** data;  /// < matrix of doubles representing the plate
+    double* data;  /// < row-major cells, 64-byte aligned unless mapped
+        /// from a file
     short isBalanced; /// < 1 if the plate is balanced, 0 otherwise
     size_t rows;  /// < number of rows in the plate
     size_t cols;  /// < number of columns in the plate
+    size_t stride;  /// < row length in doubles, padded unless mapped
+        /// from a file, where it equals cols
+    size_t mappedSize;  /// < bytes of the mapped file, 0 if data is allocated
 } Plate;
 
 /**